@@ -0,0 +1,90 @@
+// Block allocator benchmark.
+// Fills most of the disk with one big file, then times how
+// long it takes to create and write many small files on the
+// nearly full disk, where every allocation used to scan the
+// whole bitmap.
+//
+// usage: allocbench [fill-KB] [nfiles]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+#define SMALLKB 4
+
+char buf[1024];
+
+// Ticks are 10ms; print blocks/s without floating point.
+static void
+report(char *what, int nblocks, int ticks)
+{
+  if(ticks == 0)
+    ticks = 1;
+  printf(1, "allocbench: %s %d blocks in %d ticks, %d blocks/s\n",
+         what, nblocks, ticks, nblocks * 100 / ticks);
+}
+
+static void
+writefile(char *name, int kb)
+{
+  int fd, i;
+
+  fd = open(name, O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf(2, "allocbench: create %s failed\n", name);
+    exit();
+  }
+  for(i = 0; i < kb; i++){
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf(2, "allocbench: write %s failed\n", name);
+      exit();
+    }
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fillkb, nfiles, i, t0;
+  char name[8];
+
+  fillkb = 7 * 1024;
+  nfiles = 100;
+  if(argc > 1)
+    fillkb = atoi(argv[1]);
+  if(argc > 2)
+    nfiles = atoi(argv[2]);
+  if(fillkb * 2 >= MAXFILE){
+    printf(2, "allocbench: fill must be less than %d KB\n", MAXFILE / 2);
+    exit();
+  }
+
+  memset(buf, 'a', sizeof(buf));
+  t0 = uptime();
+  writefile("abfill", fillkb);
+  report("fill", fillkb * 2, uptime() - t0);
+
+  name[0] = 'a';
+  name[1] = 'b';
+  name[5] = 0;
+  t0 = uptime();
+  for(i = 0; i < nfiles; i++){
+    name[2] = '0' + i / 100 % 10;
+    name[3] = '0' + i / 10 % 10;
+    name[4] = '0' + i % 10;
+    writefile(name, SMALLKB);
+  }
+  report("small files", nfiles * SMALLKB * 2, uptime() - t0);
+
+  for(i = 0; i < nfiles; i++){
+    name[2] = '0' + i / 100 % 10;
+    name[3] = '0' + i / 10 % 10;
+    name[4] = '0' + i % 10;
+    unlink(name);
+  }
+  unlink("abfill");
+  exit();
+}
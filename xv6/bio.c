@@ -7,7 +7,8 @@
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to write it to disk.
+// * After changing buffer data, call bwrite to write it to disk,
+//     or bwritev to write several locked buffers at once.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
@@ -33,6 +34,8 @@ struct {
   // Linked list of all buffers, through prev/next.
   // head.next is most recently used.
   struct buf head;
+
+  uint nwrite;  // blocks written to disk, for bwrites()
 } bcache;
 
 void
@@ -76,8 +79,8 @@ bget(uint dev, uint blockno)
   }
 
   // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
+  // Buffers that log.c has modified but not yet installed
+  // are pinned (refcnt > 0), so they are never recycled here.
   for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
     if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
       b->dev = dev;
@@ -113,6 +116,58 @@ bwrite(struct buf *b)
     panic("bwrite");
   b->flags |= B_DIRTY;
   iderw(b);
+  acquire(&bcache.lock);
+  bcache.nwrite++;
+  release(&bcache.lock);
+}
+
+// Write the contents of n locked bufs to disk with one
+// driver request, so that runs of consecutive blocks
+// can go out as a single multi-block transfer.
+void
+bwritev(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritev");
+    bs[i]->flags |= B_DIRTY;
+  }
+  iderwv(bs, n);
+  acquire(&bcache.lock);
+  bcache.nwrite += n;
+  release(&bcache.lock);
+}
+
+// Number of blocks written to disk since boot.
+int
+bwrites(void)
+{
+  int n;
+
+  acquire(&bcache.lock);
+  n = bcache.nwrite;
+  release(&bcache.lock);
+  return n;
+}
+
+// Keep b in the cache even when no one holds it, for log.c
+// while b is part of a transaction that is not yet installed.
+void
+bpin(struct buf *b)
+{
+  acquire(&bcache.lock);
+  b->refcnt++;
+  release(&bcache.lock);
+}
+
+void
+bunpin(struct buf *b)
+{
+  acquire(&bcache.lock);
+  b->refcnt--;
+  release(&bcache.lock);
 }
 
 // Release a locked buffer.
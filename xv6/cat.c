@@ -5,12 +5,26 @@
 char buf[512];
 
 void
-cat(int fd)
+cat(FILE *f)
 {
   int n;
 
-  while((n = read(fd, buf, sizeof(buf))) > 0) {
-    if (write(1, buf, n) != n) {
+  // If either end is a pipe, let the kernel move the data.
+  fflush(stdout);
+  if((n = splice(f->fd, 1, 4096)) >= 0){
+    while(n > 0)
+      n = splice(f->fd, 1, 4096);
+    if(n < 0){
+      printf(1, "cat: write error\n");
+      exit();
+    }
+    return;
+  }
+
+  // read() rather than fread(), which waits for a whole buffer:
+  // typed lines must come back as soon as they are entered.
+  while((n = read(f->fd, buf, sizeof(buf))) > 0) {
+    if (fwrite(buf, 1, n, stdout) != n) {
       printf(1, "cat: write error\n");
       exit();
     }
@@ -24,20 +38,23 @@ cat(int fd)
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  FILE *f;
+  int i;
 
   if(argc <= 1){
-    cat(0);
+    cat(stdin);
     exit();
   }
 
+  // Files need no line-at-a-time output, even to the console.
+  setvbuf(stdout, 0, _IOFBF, 4096);
   for(i = 1; i < argc; i++){
-    if((fd = open(argv[i], 0)) < 0){
+    if((f = fopen(argv[i], "r")) == 0){
       printf(1, "cat: cannot open %s\n", argv[i]);
       exit();
     }
-    cat(fd);
-    close(fd);
+    cat(f);
+    fclose(f);
   }
   exit();
 }
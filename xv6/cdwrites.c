@@ -0,0 +1,84 @@
+// Counts the disk writes of the usertests createdelete
+// workload: several processes create files and unlink
+// every other one. Prints the blocks written to the disk,
+// in total and per file system call. Checkpointing is lazy,
+// so blocks committed but not yet written home count too.
+//
+// usage: cdwrites [nproc] [files-per-proc]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+static void
+worker(int id, int nfiles)
+{
+  char name[16];
+  int i, fd;
+
+  name[0] = 'c';
+  name[1] = 'a' + id;
+  name[3] = 0;
+  for(i = 0; i < nfiles; i++){
+    name[2] = '0' + i;
+    fd = open(name, O_CREATE | O_RDWR);
+    if(fd < 0){
+      printf(2, "cdwrites: create %s failed\n", name);
+      exit();
+    }
+    close(fd);
+    if(i > 0 && (i % 2) == 0){
+      name[2] = '0' + (i / 2);
+      if(unlink(name) < 0){
+        printf(2, "cdwrites: unlink %s failed\n", name);
+        exit();
+      }
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, nfiles, i, w0, nwrites, nops;
+  char name[4];
+
+  nproc = 4;
+  nfiles = 20;
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    nfiles = atoi(argv[2]);
+  if(nproc < 1 || nproc > 26 || nfiles < 1 || nfiles > 40){
+    printf(2, "cdwrites: nproc must be 1..26, files 1..40\n");
+    exit();
+  }
+
+  w0 = diskwrites() + logpending();
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0){
+      worker(i, nfiles);
+      exit();
+    }
+  }
+  for(i = 0; i < nproc; i++)
+    wait();
+  nwrites = diskwrites() + logpending() - w0;
+
+  // open, close and every other unlink
+  nops = nproc * (2*nfiles + (nfiles-1)/2);
+  printf(1, "cdwrites: %d fs calls, %d disk writes, %d.%d writes/call\n",
+         nops, nwrites, nwrites / nops, (nwrites * 10 / nops) % 10);
+
+  // clean up
+  name[0] = 'c';
+  name[3] = 0;
+  for(i = 0; i < nproc * nfiles; i++){
+    name[1] = 'a' + i / nfiles;
+    name[2] = '0' + i % nfiles;
+    unlink(name);
+  }
+  exit();
+}
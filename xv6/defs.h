@@ -2,7 +2,11 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
+struct lockstat;
+struct pcidev;
 struct pipe;
+struct proghdr;
 struct proc;
 struct rtcdate;
 struct spinlock;
@@ -10,12 +14,17 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct syscall_info;
+struct trapframe;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
+void            bpin(struct buf*);
+void            bunpin(struct buf*);
+int             bwrites(void);
 
 // console.c
 void            consoleinit(void);
@@ -25,18 +34,36 @@ void            panic(char*) __attribute__((noreturn));
 
 // exec.c
 int             exec(char*, char**);
+pde_t*          loadimage(char*, char**, uint*, struct trapframe*);
+char*           progname(char*);
+char*           textget(struct inode*, uint);
+void            textinit(void);
+void            textinval(struct inode*);
+void            textput(struct inode*, uint, char*);
 
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
+struct file**   fdtalloc(void);
+void            fdtdup(struct file**);
+void            fdtput(struct file**);
+struct file*    fdget(struct file**, int);
+struct file*    fdclear(struct file**, int);
 int             fileread(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int, int);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int, int);
+int             filesplice(struct file*, struct file*, int n);
+int             filecopy(struct file*, struct file*, int n);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
+int             copyi(struct inode*, uint, struct inode*, uint, uint);
+void            dcacheinval(struct inode*, char*);
+void            dcachestat(uint*, uint*);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
@@ -50,6 +77,7 @@ void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
+int             rename(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
@@ -58,15 +86,18 @@ int             writei(struct inode*, char*, uint, uint);
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderwv(struct buf**, int);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
 extern uchar    ioapicid;
 void            ioapicinit(void);
+void            ioapicroute(int irq, int vecirq, int cpu);
 
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
+void            kref(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
@@ -87,6 +118,11 @@ void            initlog(int dev);
 void            log_write(struct buf*);
 void            begin_op();
 void            end_op();
+void            begin_opn(int);
+void            end_opn(int);
+int             logbudget(int);
+int             logcommits(void);
+int             logpending(void);
 
 // mp.c
 extern int      ismp;
@@ -100,13 +136,33 @@ void            picinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
+int             pipereadv(struct pipe*, struct iovec*, int);
 int             pipewrite(struct pipe*, char*, int);
+int             pipegetsize(struct pipe*);
+int             pipesetsize(struct pipe*, int);
+int             pipepeek(struct pipe*, char**, int);
+void            pipeconsume(struct pipe*, int);
+int             pipereserve(struct pipe*, char**, int);
+void            pipecommit(struct pipe*, int);
+
+// pci.c
+uint            pciconfread(struct pcidev*, uint);
+void            pciconfwrite(struct pcidev*, uint, uint);
+int             pcifind(int, int, int, struct pcidev*);
+void            pcienable(struct pcidev*);
 
 //PAGEBREAK: 16
 // proc.c
 int             cpuid(void);
+int             cswitches(void);
 void            exit(void);
 int             fork(void);
+int             clone(void(*)(void*, void*), void*, void*, void*);
+int             join(void**);
+int             vmshared(struct proc*);
+int             futex_wait(uint, uint);
+int             futex_wake(uint, int);
+int             spawn(char*, char**, struct file**);
 int             growproc(int);
 int             kill(int);
 struct cpu*     mycpu(void);
@@ -126,6 +182,10 @@ int             get_process_by_pid(int, struct proc**);
 int             list_all_processes(void);
 void            find_palindrome(int);
 
+// ucopy.S
+int             ucopy(void*, void*, uint);
+int             ustrlen(char*, uint);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
@@ -135,6 +195,8 @@ void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
+int             lockstatget(int, struct lockstat*);
+void            lockstatreset(void);
 void            pushcli(void);
 void            popcli(void);
 
@@ -152,13 +214,15 @@ char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
+void            strinit(void);
 
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
-int             argstr(int, char**);
+int             argwptr(int, char**, int);
+int             argstr(int, char*, int);
 int             fetchint(uint, int*);
-int             fetchstr(uint, char**);
+int             fetchstr(uint, char*, int);
 void            syscall(void);
 
 // timer.c
@@ -184,11 +248,15 @@ int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
+int             loaduvm(pde_t*, struct inode*, struct proghdr*);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
+int             copyin(void*, uint, uint);
+int             uvmcow(pde_t*, uint);
+int             uvmcowall(pde_t*, uint);
+int             uvmwritable(pde_t*, uint, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
 
 // number of elements in fixed-size array
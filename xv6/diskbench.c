@@ -0,0 +1,76 @@
+// Disk throughput benchmark.
+// Writes and reads back a file several times and reports KB/s.
+// Run it on kernels built with "make qemu" (ide.c) and
+// "make qemu DISK=virtio" (virtio.c) to compare the drivers.
+//
+// usage: diskbench [rounds]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+#define FILEKB  1024   // uses the double-indirect block
+#define CHUNK   4096
+
+char buf[CHUNK];
+
+// Ticks are 10ms; print KB/s without floating point.
+static void
+report(char *what, int kb, int ticks)
+{
+  if(ticks == 0)
+    ticks = 1;
+  printf(1, "diskbench: %s %d KB in %d ticks, %d KB/s\n",
+         what, kb, ticks, kb * 100 / ticks);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rounds, r, i, fd, t0, wticks, rticks;
+
+  rounds = 20;
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+
+  for(i = 0; i < CHUNK; i++)
+    buf[i] = 'a' + i % 26;
+
+  wticks = rticks = 0;
+  for(r = 0; r < rounds; r++){
+    t0 = uptime();
+    fd = open("diskbench.tmp", O_CREATE | O_RDWR);
+    if(fd < 0){
+      printf(2, "diskbench: cannot create file\n");
+      exit();
+    }
+    for(i = 0; i < FILEKB*1024/CHUNK; i++){
+      if(write(fd, buf, CHUNK) != CHUNK){
+        printf(2, "diskbench: write failed\n");
+        exit();
+      }
+    }
+    close(fd);
+    wticks += uptime() - t0;
+
+    // The file is bigger than the buffer cache, so most
+    // of the reads go to the disk.
+    t0 = uptime();
+    fd = open("diskbench.tmp", O_RDONLY);
+    for(i = 0; i < FILEKB*1024/CHUNK; i++){
+      if(read(fd, buf, CHUNK) != CHUNK){
+        printf(2, "diskbench: read failed\n");
+        exit();
+      }
+    }
+    close(fd);
+    rticks += uptime() - t0;
+    unlink("diskbench.tmp");
+  }
+
+  report("write", rounds*FILEKB, wticks);
+  report("read", rounds*FILEKB, rticks);
+  exit();
+}
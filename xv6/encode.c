@@ -18,17 +18,17 @@ char encode(char c) {
 int main(int argc,char *argv[]) {
   //  unlink("result.txt");
 
-    int fd = open("result.txt", O_CREATE|O_RDWR );
+    FILE *f = fopen("result.txt", "w");
     for (int i = 1; i < argc ; i++) {
         for (int j=0; j< strlen(argv[i]); j++){
             char processedChar = encode(argv[i][j]);
-            write(fd, &processedChar, 1);
+            fputc(processedChar, f);
         }
         
-        write(fd," ",1);                
+        fputc(' ', f);                
     }
-    write(fd,"\n",1);
+    fputc('\n', f);
 
-    close(fd);
+    fclose(f);
     exit();
 }
@@ -6,55 +6,205 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
-int
-exec(char *path, char **argv)
+// Program page cache.
+//
+// exec keeps the loaded pages of recently run programs, keyed
+// by device and inode number, so that running a program again
+// need not read it from its file. loaduvm() maps the cached
+// pages of read-only segments into each process, shared, and
+// copies those of writable ones. Changing a program's file
+// drops its pages (see textinval()).
+//
+// Entries are filled and invalidated with the program's inode
+// locked, so only the table itself needs tcache.lock.
+
+#define NTEXT     16  // programs cached
+#define TEXTPAGES 64  // most pages cached for one program
+
+struct text {
+  uint dev;
+  uint inum;              // 0 if unused
+  uint used;              // tcache.clock when last used
+  char *page[TEXTPAGES];  // loaded page at each user page, or 0
+};
+
+struct {
+  struct spinlock lock;
+  uint clock;
+  struct text text[NTEXT];
+} tcache;
+
+void
+textinit(void)
 {
-  char *s, *last;
-  int i, off;
+  initlock(&tcache.lock, "tcache");
+}
+
+static struct text*
+textfind(struct inode *ip)
+{
+  struct text *t;
+
+  for(t = tcache.text; t < &tcache.text[NTEXT]; t++)
+    if(t->inum == ip->inum && t->dev == ip->dev)
+      return t;
+  return 0;
+}
+
+// Drop t's pages. Caller holds tcache.lock.
+static void
+textfree(struct text *t)
+{
+  int i;
+
+  for(i = 0; i < TEXTPAGES; i++)
+    if(t->page[i]){
+      kfree(t->page[i]);
+      t->page[i] = 0;
+    }
+  t->inum = 0;
+}
+
+// The cached page of ip at user address va, with a reference
+// for the caller, or 0.
+char*
+textget(struct inode *ip, uint va)
+{
+  struct text *t;
+  char *mem;
+
+  if(va / PGSIZE >= TEXTPAGES)
+    return 0;
+  acquire(&tcache.lock);
+  mem = 0;
+  if((t = textfind(ip)) != 0 && (mem = t->page[va / PGSIZE]) != 0){
+    kref(mem);
+    t->used = ++tcache.clock;
+  }
+  release(&tcache.lock);
+  return mem;
+}
+
+// Cache mem as the page of ip at user address va, taking over
+// the caller's reference. Evicts the least recently used
+// program if need be.
+void
+textput(struct inode *ip, uint va, char *mem)
+{
+  struct text *t, *lru;
+
+  if(va / PGSIZE >= TEXTPAGES){
+    kfree(mem);
+    return;
+  }
+  acquire(&tcache.lock);
+  if((t = textfind(ip)) == 0){
+    lru = tcache.text;
+    for(t = tcache.text; t < &tcache.text[NTEXT]; t++){
+      if(t->inum == 0)
+        break;
+      if(t->used < lru->used)
+        lru = t;
+    }
+    if(t == &tcache.text[NTEXT]){
+      t = lru;
+      textfree(t);
+    }
+    t->dev = ip->dev;
+    t->inum = ip->inum;
+  }
+  t->used = ++tcache.clock;
+  if(t->page[va / PGSIZE])
+    kfree(t->page[va / PGSIZE]);
+  t->page[va / PGSIZE] = mem;
+  release(&tcache.lock);
+}
+
+// ip's contents are changing: forget its pages. Called with ip
+// locked, so no entry for ip can appear during the unlocked
+// search.
+void
+textinval(struct inode *ip)
+{
+  struct text *t;
+
+  if(textfind(ip) == 0)
+    return;
+  acquire(&tcache.lock);
+  if((t = textfind(ip)) != 0)
+    textfree(t);
+  release(&tcache.lock);
+}
+
+#define NPH 8  // most program headers in a program
+
+// Load the program at path into a new page table, with argv
+// on its stack, and point tf at its entry. Used by exec and
+// spawn; the caller installs the page table.
+pde_t*
+loadimage(char *path, char **argv, uint *szp, struct trapframe *tf)
+{
+  int i, n, len;
   uint argc, sz, sp, ustack[3+MAXARG+1];
-  struct elfhdr elf;
+  struct {
+    struct elfhdr elf;
+    struct proghdr ph[NPH];
+  } h;
+  struct proghdr *ph;
   struct inode *ip;
-  struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
-  struct proc *curproc = myproc();
+  char *stack;
+  pde_t *pgdir;
 
   begin_op();
 
   if((ip = namei(path)) == 0){
     end_op();
     cprintf("exec: fail\n");
-    return -1;
+    return 0;
   }
   ilock(ip);
   pgdir = 0;
 
-  // Check ELF header
-  if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
+  // Check ELF header. The program headers usually follow it,
+  // and come in the same read.
+  n = readi(ip, (char*)&h, 0, sizeof(h));
+  if(n < (int)sizeof(h.elf) || h.elf.magic != ELF_MAGIC)
     goto bad;
-  if(elf.magic != ELF_MAGIC)
+  if(h.elf.phnum > NPH || h.elf.phentsize != sizeof(struct proghdr))
     goto bad;
+  len = h.elf.phnum * sizeof(struct proghdr);
+  if(h.elf.phoff != sizeof(h.elf) || sizeof(h.elf) + len > n){
+    if(readi(ip, (char*)h.ph, h.elf.phoff, len) != len)
+      goto bad;
+  }
 
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
   // Load program into memory.
   sz = 0;
-  for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
-    if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
-      goto bad;
-    if(ph.type != ELF_PROG_LOAD)
+  for(i = 0; i < h.elf.phnum; i++){
+    ph = &h.ph[i];
+    if(ph->type != ELF_PROG_LOAD)
       continue;
-    if(ph.memsz < ph.filesz)
+    if(ph->memsz < ph->filesz)
       goto bad;
-    if(ph.vaddr + ph.memsz < ph.vaddr)
+    if(ph->vaddr + ph->memsz < ph->vaddr || ph->vaddr + ph->memsz >= HEAPLIMIT)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(PGROUNDDOWN(ph->vaddr) < PGROUNDUP(sz))
       goto bad;
-    if(ph.vaddr % PGSIZE != 0)
+    // Fill any gap before the segment, as sz covers it.
+    if(PGROUNDDOWN(ph->vaddr) > sz &&
+       (sz = allocuvm(pgdir, sz, PGROUNDDOWN(ph->vaddr))) == 0)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(loaduvm(pgdir, ip, ph) < 0)
       goto bad;
+    sz = ph->vaddr + ph->memsz;
   }
   iunlockput(ip);
   end_op();
@@ -66,32 +216,75 @@ exec(char *path, char **argv)
   if((sz = allocuvm(pgdir, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
   clearpteu(pgdir, (char*)(sz - 2*PGSIZE));
-  sp = sz;
 
   // Push argument strings, prepare rest of stack in ustack.
+  // The stack page is new, so write it in place; sp is an
+  // offset in it.
+  stack = uva2ka(pgdir, (char*)(sz - PGSIZE));
+  sp = PGSIZE;
   for(argc = 0; argv[argc]; argc++) {
     if(argc >= MAXARG)
       goto bad;
-    sp = (sp - (strlen(argv[argc]) + 1)) & ~3;
-    if(copyout(pgdir, sp, argv[argc], strlen(argv[argc]) + 1) < 0)
+    len = strlen(argv[argc]) + 1;
+    if(len > sp)
       goto bad;
-    ustack[3+argc] = sp;
+    sp = (sp - len) & ~3;
+    memmove(stack + sp, argv[argc], len);
+    ustack[3+argc] = sz - PGSIZE + sp;
   }
   ustack[3+argc] = 0;
 
   ustack[0] = 0xffffffff;  // fake return PC
   ustack[1] = argc;
-  ustack[2] = sp - (argc+1)*4;  // argv pointer
+  ustack[2] = sz - PGSIZE + sp - (argc+1)*4;  // argv pointer
 
-  sp -= (3+argc+1) * 4;
-  if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
+  if(sp < (3+argc+1) * 4)
     goto bad;
+  sp -= (3+argc+1) * 4;
+  memmove(stack + sp, ustack, (3+argc+1) * 4);
+
+  tf->eip = h.elf.entry;  // main
+  tf->esp = sz - PGSIZE + sp;
+  *szp = sz;
+  return pgdir;
+
+ bad:
+  if(pgdir)
+    freevm(pgdir);
+  if(ip){
+    iunlockput(ip);
+    end_op();
+  }
+  return 0;
+}
+
+// The last element of path, as a process name.
+char*
+progname(char *path)
+{
+  char *s, *last;
 
-  // Save program name for debugging.
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
-  safestrcpy(curproc->name, last, sizeof(curproc->name));
+  return last;
+}
+
+int
+exec(char *path, char **argv)
+{
+  uint sz;
+  pde_t *pgdir, *oldpgdir;
+  struct proc *curproc = myproc();
+
+  // Other threads would be left running in the old image.
+  if(vmshared(curproc))
+    return -1;
+  if((pgdir = loadimage(path, argv, &sz, curproc->tf)) == 0)
+    return -1;
+
+  // Save program name for debugging.
+  safestrcpy(curproc->name, progname(path), sizeof(curproc->name));
 
   for(int i = 0; i < SHAREDREGIONS; i++) {
     if(curproc->pages[i].shmid != -1 && curproc->pages[i].key != -1) {
@@ -103,18 +296,7 @@ exec(char *path, char **argv)
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
-  curproc->tf->eip = elf.entry;  // main
-  curproc->tf->esp = sp;
   switchuvm(curproc);
   freevm(oldpgdir);
   return 0;
-
- bad:
-  if(pgdir)
-    freevm(pgdir);
-  if(ip){
-    iunlockput(ip);
-    end_op();
-  }
-  return -1;
 }
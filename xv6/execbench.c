@@ -0,0 +1,112 @@
+// exec benchmark. Prints microseconds per launch for:
+//   programs    spawn() and wait() of some of the user programs,
+//               their output going to a scratch file
+//   exec loop   this program exec()ing itself n times in a row,
+//               with no fork or wait in between
+//
+// usage: execbench [n]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "spawn.h"
+
+char *progs[][3] = {
+  { "echo", "hi", 0 },
+  { "cat", "README", 0 },
+  { "ls", "/", 0 },
+  { "wc", "README", 0 },
+  { "grep", "xv6", "README" },
+};
+
+// Ticks are 10ms.
+static void
+report(char *what, int n, int ticks)
+{
+  printf(1, "execbench: %s %d in %d ticks, %d us each\n",
+         what, n, ticks, ticks * 10000 / n);
+}
+
+static void
+itoa(char *s, int n)
+{
+  char t[12];
+  int i;
+
+  i = 0;
+  do {
+    t[i++] = '0' + n % 10;
+    n /= 10;
+  } while(n > 0);
+  while(i > 0)
+    *s++ = t[--i];
+  *s = 0;
+}
+
+// One step of the exec loop: left execs to go, of n started
+// at tick t0.
+static void
+chain(int left, char *n, char *t0)
+{
+  char s[12], *argv[6];
+
+  if(left == 0){
+    report("exec loop", atoi(n), uptime() - atoi(t0));
+    exit();
+  }
+  itoa(s, left - 1);
+  argv[0] = "execbench";
+  argv[1] = "-";
+  argv[2] = s;
+  argv[3] = n;
+  argv[4] = t0;
+  argv[5] = 0;
+  exec(argv[0], argv);
+  printf(2, "execbench: exec failed\n");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct spawnact act;
+  char *pargv[4], n[12], t0[12];
+  int i, j, count, t;
+
+  if(argc == 5 && strcmp(argv[1], "-") == 0)
+    chain(atoi(argv[2]), argv[3], argv[4]);
+  count = argc > 1 ? atoi(argv[1]) : 100;
+  if(count <= 0){
+    printf(2, "usage: execbench [n]\n");
+    exit();
+  }
+
+  act.op = SPAWN_OPEN;
+  act.fd = 1;
+  act.arg = O_CREATE|O_WRONLY;
+  act.path = "execbench.out";
+  for(i = 0; i < sizeof(progs)/sizeof(progs[0]); i++){
+    pargv[0] = progs[i][0];
+    pargv[1] = progs[i][1];
+    pargv[2] = progs[i][2];
+    pargv[3] = 0;
+    t = uptime();
+    for(j = 0; j < count; j++){
+      if(spawn(pargv[0], pargv, &act, 1) < 0){
+        printf(2, "execbench: spawn %s failed\n", pargv[0]);
+        exit();
+      }
+      wait();
+    }
+    report(pargv[0], count, uptime() - t);
+  }
+  unlink("execbench.out");
+
+  itoa(n, count);
+  itoa(t0, uptime());
+  if(fork() == 0)
+    chain(count, n, t0);
+  wait();
+  exit();
+}
@@ -3,12 +3,14 @@
 //
 
 #include "types.h"
+#include "stat.h"
 #include "defs.h"
 #include "param.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -16,6 +18,16 @@ struct {
   struct file file[NFILE];
 } ftable;
 
+// Descriptor tables. A process's table is shared by its
+// threads; p->ofile points at it. Reference counts are
+// protected by ftable.lock.
+struct fdtable {
+  struct file *ofile[NOFILE];  // first, so a table is its ofile
+  int ref;
+};
+
+static struct fdtable fdtables[NPROC];
+
 void
 fileinit(void)
 {
@@ -52,6 +64,91 @@ filedup(struct file *f)
   return f;
 }
 
+// Allocate an empty descriptor table.
+struct file**
+fdtalloc(void)
+{
+  struct fdtable *t;
+
+  acquire(&ftable.lock);
+  for(t = fdtables; t < fdtables + NPROC; t++){
+    if(t->ref == 0){
+      t->ref = 1;
+      release(&ftable.lock);
+      memset(t->ofile, 0, sizeof(t->ofile));
+      return t->ofile;
+    }
+  }
+  release(&ftable.lock);
+  return 0;
+}
+
+// Share the descriptor table ofile with another thread.
+void
+fdtdup(struct file **ofile)
+{
+  acquire(&ftable.lock);
+  ((struct fdtable*)ofile)->ref++;
+  release(&ftable.lock);
+}
+
+// Take a reference to the file at descriptor fd of ofile,
+// or return 0 if there is none. The reference keeps it open
+// if another thread closes fd meanwhile.
+struct file*
+fdget(struct file **ofile, int fd)
+{
+  struct file *f;
+
+  acquire(&ftable.lock);
+  if((f = ofile[fd]) != 0)
+    f->ref++;
+  release(&ftable.lock);
+  return f;
+}
+
+// Empty descriptor fd of ofile, returning the file that was
+// there, or 0. The caller takes over its reference.
+struct file*
+fdclear(struct file **ofile, int fd)
+{
+  struct file *f;
+
+  acquire(&ftable.lock);
+  f = ofile[fd];
+  ofile[fd] = 0;
+  release(&ftable.lock);
+  return f;
+}
+
+// Drop a reference to the descriptor table ofile, closing
+// its files if it was the last.
+void
+fdtput(struct file **ofile)
+{
+  struct fdtable *t;
+  int fd;
+
+  t = (struct fdtable*)ofile;
+  acquire(&ftable.lock);
+  if(t->ref > 1){
+    t->ref--;
+    release(&ftable.lock);
+    return;
+  }
+  release(&ftable.lock);
+
+  for(fd = 0; fd < NOFILE; fd++){
+    if(ofile[fd]){
+      fileclose(ofile[fd]);
+      ofile[fd] = 0;
+    }
+  }
+  acquire(&ftable.lock);
+  t->ref = 0;
+  release(&ftable.lock);
+}
+
 // Close file f.  (Decrement ref count, close when reaches 0.)
 void
 fileclose(struct file *f)
@@ -92,66 +189,263 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
-// Read from file f.
+// Read from file f into the cnt segments of iov, at offset off,
+// or at f->off, advancing it, if off is -1. Stops at the first
+// segment that is not filled. Like read(), only waits for the
+// first bytes: a pipe fills the segments with what it has, and
+// a device stops after one short read. Offsets only apply to
+// inodes.
 int
-fileread(struct file *f, char *addr, int n)
+filereadv(struct file *f, struct iovec *iov, int cnt, int off)
 {
-  int r;
+  int i, r, tot;
+  uint pos;
 
   if(f->readable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+  if(f->type == FD_PIPE){
+    if(off != -1)
+      return -1;
+    return pipereadv(f->pipe, iov, cnt);
+  }
   if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
-      f->off += r;
+    pos = off == -1 ? f->off : off;
+    for(tot = i = 0; i < cnt; i++){
+      if((r = readi(f->ip, iov[i].iov_base, pos, iov[i].iov_len)) < 0){
+        if(tot == 0)
+          tot = -1;
+        break;
+      }
+      pos += r;
+      tot += r;
+      if(r < iov[i].iov_len || (f->ip->type == T_DEV && r > 0))
+        break;
+    }
+    if(off == -1)
+      f->off = pos;
     iunlock(f->ip);
-    return r;
+    return tot;
   }
   panic("fileread");
 }
 
+// Read from file f.
+int
+fileread(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return filereadv(f, &iov, 1, -1);
+}
+
 //PAGEBREAK!
-// Write to file f.
+// Log blocks a write of n bytes may dirty: n/BSIZE data
+// blocks plus 2 of slop for non-aligned writes, a bitmap
+// block for each, the indirect blocks above them (single,
+// double and the double's second-level blocks), which may
+// be allocated too, and the i-node.
+static int
+writeblocks(int n)
+{
+  int nb;
+
+  nb = n/BSIZE + 2;
+  return 2*nb + 2*(nb/NINDIRECT + 3) + 1;
+}
+
+// The most bytes one transaction of at most nblk blocks
+// can write.
+static int
+writemax(int nblk)
+{
+  int n;
+
+  for(n = ((nblk-1)/2 - 3) * BSIZE; n > 0 && writeblocks(n) > nblk; n -= BSIZE)
+    ;
+  return n;
+}
+
+// Write the cnt segments of iov to file f, at offset off, or
+// at f->off, advancing it, if off is -1. Offsets only apply
+// to inodes.
 int
-filewrite(struct file *f, char *addr, int n)
+filewritev(struct file *f, struct iovec *iov, int cnt, int off)
 {
-  int r;
+  int i, j, r, n, m, max, done, tot, nblk;
+  uint pos;
 
   if(f->writable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+  if(f->type == FD_PIPE){
+    if(off != -1)
+      return -1;
+    for(tot = i = 0; i < cnt; i++){
+      if(pipewrite(f->pipe, iov[i].iov_base, iov[i].iov_len) < 0)
+        return -1;
+      tot += iov[i].iov_len;
+    }
+    return tot;
+  }
   if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
+    // write as much per transaction as the log's budget
+    // allows, reserving only what the rest of the write
+    // needs. Small segments share a transaction.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
+    pos = off;
+    i = done = tot = 0;
+    r = 0;
+    while(i < cnt && r >= 0){
+      max = writemax(logbudget(0));
+      for(n = -done, j = i; j < cnt && n < max; j++)
+        n += iov[j].iov_len;
+      if(n > max)
+        n = max;
+      max = n;
+      nblk = writeblocks(max);
+      begin_opn(nblk);
       ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
+      if(off == -1)
+        pos = f->off;
+      for(n = 0; i < cnt; n += r){
+        if(done == iov[i].iov_len){
+          i++;
+          done = 0;
+          r = 0;
+          continue;
+        }
+        if(n == max)
+          break;
+        m = iov[i].iov_len - done;
+        if(m > max - n)
+          m = max - n;
+        if((r = writei(f->ip, (char*)iov[i].iov_base + done, pos, m)) < 0)
+          break;
+        if(r != m)
+          panic("short filewrite");
+        pos += r;
+        done += r;
+        tot += r;
+      }
+      if(off == -1)
+        f->off = pos;
       iunlock(f->ip);
-      end_op();
-
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
+      end_opn(nblk);
     }
-    return i == n ? n : -1;
+    return r < 0 ? -1 : tot;
   }
   panic("filewrite");
 }
 
+// Write to file f.
+int
+filewrite(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return filewritev(f, &iov, 1, -1);
+}
+
+// Move up to n bytes from file f to file g, at least one of
+// which is a pipe, without copying them through user memory:
+// the pipe lends its buffer, which is read or written in place.
+// Returns the number of bytes moved, 0 at end of file.
+int
+filesplice(struct file *f, struct file *g, int n)
+{
+  char *addr;
+  int m, r;
+
+  if(f->readable == 0 || g->writable == 0 || n < 0)
+    return -1;
+  if(n == 0)
+    return 0;
+  if(f->type == FD_PIPE){
+    if(g->type == FD_PIPE && g->pipe == f->pipe)
+      return -1;
+    if((m = pipepeek(f->pipe, &addr, n)) <= 0)
+      return m;
+    r = filewrite(g, addr, m);
+    pipeconsume(f->pipe, r > 0 ? r : 0);
+    return r;
+  }
+  if(g->type == FD_PIPE && f->type == FD_INODE){
+    if((m = pipereserve(g->pipe, &addr, n)) < 0)
+      return -1;
+    r = fileread(f, addr, m);
+    pipecommit(g->pipe, r > 0 ? r : 0);
+    return r;
+  }
+  return -1;
+}
+
+// Copy up to n bytes from file f to file g, both on disk, at
+// and advancing their offsets, without copying them through
+// user memory: each block goes from one cached buffer to the
+// other, in transactions as large as the log's budget allows.
+// Returns the number of bytes copied, 0 at end of file.
+int
+filecopy(struct file *f, struct file *g, int n)
+{
+  struct inode *a, *b;
+  int r, m, tot, nblk;
+
+  if(f->readable == 0 || g->writable == 0 || n < 0)
+    return -1;
+  if(f->type != FD_INODE || g->type != FD_INODE)
+    return -1;
+  a = f->ip;
+  b = g->ip;
+  // Only plain files, checked one lock at a time: the ordered
+  // pair below is not safe for a directory, which create and
+  // unlink lock before its children.
+  ilock(a);
+  r = a->type;
+  iunlock(a);
+  if(r != T_FILE)
+    return -1;
+  ilock(b);
+  r = b->type;
+  iunlock(b);
+  if(r != T_FILE)
+    return -1;
+  r = 0;
+  for(tot = 0; tot < n; ){
+    m = writemax(logbudget(0));
+    if(m > n - tot)
+      m = n - tot;
+    nblk = writeblocks(m);
+    begin_opn(nblk);
+    // Lock in inode number order, so that two copies in
+    // opposite directions cannot deadlock.
+    if(a == b)
+      ilock(a);
+    else if(a->inum < b->inum){
+      ilock(a);
+      ilock(b);
+    } else {
+      ilock(b);
+      ilock(a);
+    }
+    if(a == b && f->off < g->off + m && g->off < f->off + m)
+      r = -1;  // overlapping ranges of one file
+    else if((r = copyi(a, f->off, b, g->off, m)) > 0){
+      f->off += r;
+      g->off += r;
+    }
+    iunlock(a);
+    if(a != b)
+      iunlock(b);
+    end_opn(nblk);
+    if(r > 0)
+      tot += r;
+    if(r < m)
+      break;
+  }
+  return tot > 0 ? tot : r;
+}
@@ -0,0 +1,99 @@
+// Formatted output benchmark. Two children each print the
+// same lines to a file: one with the old printf, which issued
+// one write() per character, the other with the current
+// printf, which issues one write() per call. Each prints its
+// ticks and its syscall counts (write is 16).
+//
+// usage: fmtbench [lines]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+static void
+oldputc(int fd, char c)
+{
+  write(fd, &c, 1);
+}
+
+static void
+oldprintint(int fd, int x, int base)
+{
+  static char digits[] = "0123456789ABCDEF";
+  char buf[16];
+  int i;
+
+  i = 0;
+  do{
+    buf[i++] = digits[x % base];
+  }while((x /= base) != 0);
+  while(--i >= 0)
+    oldputc(fd, buf[i]);
+}
+
+// The old printf, cut down to the conversions used below.
+static void
+oldprintf(int fd, char *fmt, ...)
+{
+  char *s;
+  uint *ap;
+  int i;
+
+  ap = (uint*)(void*)&fmt + 1;
+  for(i = 0; fmt[i]; i++){
+    if(fmt[i] != '%'){
+      oldputc(fd, fmt[i]);
+      continue;
+    }
+    i++;
+    if(fmt[i] == 'd')
+      oldprintint(fd, *ap++, 10);
+    else if(fmt[i] == 'x')
+      oldprintint(fd, *ap++, 16);
+    else if(fmt[i] == 's')
+      for(s = (char*)*ap++; *s; s++)
+        oldputc(fd, *s);
+  }
+}
+
+static void
+run(char *name, int lines, int old)
+{
+  int fd, i, t0;
+
+  if(fork() == 0){
+    fd = open(name, O_CREATE|O_RDWR);
+    if(fd < 0){
+      printf(2, "fmtbench: cannot create %s\n", name);
+      exit();
+    }
+    t0 = uptime();
+    for(i = 0; i < lines; i++){
+      if(old)
+        oldprintf(fd, "line %d of %d: block %x in %s\n", i, lines, i*512, name);
+      else
+        printf(fd, "line %d of %d: block %x in %s\n", i, lines, i*512, name);
+    }
+    close(fd);
+    printf(1, "fmtbench: %s %d lines in %d ticks\n",
+           old ? "bytewise" : "buffered", lines, uptime() - t0);
+    sort_syscalls(getpid());
+    unlink(name);
+    exit();
+  }
+  wait();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int lines;
+
+  lines = 500;
+  if(argc > 1)
+    lines = atoi(argv[1]);
+  run("fmt.old", lines, 1);
+  run("fmt.new", lines, 0);
+  exit();
+}
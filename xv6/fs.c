@@ -13,6 +13,7 @@
 #include "defs.h"
 #include "param.h"
 #include "stat.h"
+#include "x86.h"
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
@@ -23,6 +24,8 @@
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void dcacheinit(void);
+static void dcachepurge(struct inode*);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -52,25 +55,89 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// In-memory summary of the free-block bitmap: how many free
+// blocks each bitmap block describes, or -1 if not yet counted.
+// balloc() skips full bitmap blocks without reading them.
+// nfree[i] only changes while holding bitmap block i's buffer.
+#define NBMAP (FSSIZE/BPB + 1)
+static int nfree[NBMAP];
+
+// Number of clear bits among the first n bits of bitmap block data.
+static int
+bcount(uchar *data, int n)
+{
+  uint *w = (uint*)data;
+  uint x;
+  int i, c;
+
+  c = 0;
+  for(i = 0; i < n; i += 32){
+    x = ~w[i/32];
+    if(n - i < 32)
+      x &= (1U << (n - i)) - 1;
+    for(; x; x &= x - 1)
+      c++;
+  }
+  return c;
+}
+
+// Find a clear bit at or after bit bi and below bit n in bitmap
+// block data, a 32-bit word at a time. Returns -1 if there is none.
+static int
+bfind(uchar *data, int bi, int n)
+{
+  uint *w = (uint*)data;
+  uint x;
+  int i;
+
+  for(i = bi/32; i*32 < n; i++){
+    x = ~w[i];
+    if(i == bi/32)
+      x &= ~0U << (bi%32);
+    if(x == 0)
+      continue;
+    for(bi = i*32; (x & 1) == 0; bi++)
+      x >>= 1;
+    return bi < n ? bi : -1;
+  }
+  return -1;
+}
+
+// Allocate a zeroed disk block, as close after goal as possible.
 static uint
-balloc(uint dev)
+balloc(uint dev, uint goal)
 {
-  int b, bi, m;
+  int b, bi, i, k, n, nbm;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+  nbm = (sb.size + BPB - 1) / BPB;
+  if(nbm > NBMAP)
+    panic("balloc: bitmap too big");
+  if(goal >= sb.size)
+    goal = 0;
+
+  // Bitmap blocks from the goal's onwards, wrapping around.
+  for(k = 0; k < nbm; k++){
+    i = (goal/BPB + k) % nbm;
+    if(nfree[i] == 0)
+      continue;
+    b = i * BPB;
+    n = min(BPB, sb.size - b);
+    bp = bread(dev, sb.bmapstart + i);
+    if(nfree[i] < 0)
+      nfree[i] = bcount(bp->data, n);
+    bi = -1;
+    if(k == 0)
+      bi = bfind(bp->data, goal % BPB, n);
+    if(bi < 0)
+      bi = bfind(bp->data, 0, n);
+    if(bi >= 0){
+      bp->data[bi/8] |= 1 << (bi % 8);  // Mark block in use.
+      nfree[i]--;
+      log_write(bp);
+      brelse(bp);
+      bzero(dev, b + bi);
+      return b + bi;
     }
     brelse(bp);
   }
@@ -90,6 +157,8 @@ bfree(int dev, uint b)
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
+  if(nfree[b/BPB] >= 0)
+    nfree[b/BPB]++;
   log_write(bp);
   brelse(bp);
 }
@@ -119,18 +188,18 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a cache entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in cache: ip->ref tracks the number of
+//   in-memory pointers to the entry (open files and current
+//   directories). iget() finds or creates a cache entry and
+//   increments its ref; iput() decrements ref. An entry whose
+//   ref is zero stays in the cache, on an LRU list, until
+//   iget() needs it for another inode.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
-//   ilock() reads the inode from
-//   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ilock() reads the inode from the disk and sets
+//   ip->valid, while iput() clears ip->valid when it
+//   frees the inode.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -154,29 +223,65 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// The cache starts with NINODE entries and grows a page of
+// entries at a time, up to NINODEMAX, before it recycles the
+// least recently used unreferenced one. Entries are never
+// freed, and are found through a hash table on (dev, inum).
+//
+// The icache.lock spin-lock protects the hash chains, the LRU
+// list, and changes to ip->dev and ip->inum, which only happen
+// to an entry with ref zero. ip->ref is changed atomically, so
+// that iget() can take a reference to an entry that already
+// has one without the lock: it checks dev and inum again once
+// it holds the reference. ref goes from zero to one, or from
+// one to zero, only with icache.lock held.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum and the list links.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 64
+
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *hash[NIHASH];
+  struct inode *free;   // never used entries, linked by hnext
+  int n;                // number of entries
+  struct inode lru;     // head of LRU list; lru.lnext is most recent
 } icache;
 
+// Put the n entries at ip on the free list.
+static void
+ifree(struct inode *ip, int n)
+{
+  for(; n > 0; n--, ip++){
+    initsleeplock(&ip->lock, "inode");
+    ip->hnext = icache.free;
+    icache.free = ip;
+    icache.n++;
+  }
+}
+
+// Renames are serialized, so that the shape of the directory
+// tree, which decides the order in which a rename locks its
+// two directories, cannot change while one is in progress.
+static struct sleeplock renamelock;
+
 void
 iinit(int dev)
 {
   int i = 0;
   
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  initsleeplock(&renamelock, "rename");
+  dcacheinit();
+  icache.lru.lprev = &icache.lru;
+  icache.lru.lnext = &icache.lru;
+  ifree(icache.inode, NINODE);
+
+  for(i = 0; i < NBMAP; i++)
+    nfree[i] = -1;
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
@@ -235,37 +340,117 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+static struct inode**
+ihash(uint dev, uint inum)
+{
+  return &icache.hash[(dev*31 + inum) % NIHASH];
+}
+
+// Increment ip->ref if it is not zero. Returns the old value.
+static int
+iref(struct inode *ip)
+{
+  int r;
+
+  do {
+    r = ip->ref;
+  } while(r > 0 && cmpxchg((uint*)&ip->ref, r, r+1) != r);
+  return r;
+}
+
+// Drop a reference to ip, putting it on the LRU list
+// if it was the last.
+static void
+irele(struct inode *ip)
+{
+  int r;
+
+  for(;;){
+    r = ip->ref;
+    if(r > 1){
+      if(cmpxchg((uint*)&ip->ref, r, r-1) == r)
+        return;
+      continue;
+    }
+    if(r < 1)
+      panic("irele");
+    acquire(&icache.lock);
+    if(cmpxchg((uint*)&ip->ref, 1, 0) == 1){
+      ip->lnext = icache.lru.lnext;
+      ip->lprev = &icache.lru;
+      icache.lru.lnext->lprev = ip;
+      icache.lru.lnext = ip;
+      release(&icache.lock);
+      return;
+    }
+    release(&icache.lock);
+  }
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **hp;
+  char *page;
+  int i;
+
+  // Is the inode cached and referenced? Then take a reference
+  // without the lock. The entry may be recycled for another
+  // inode until we hold a reference, so check again after.
+  hp = ihash(dev, inum);
+  for(ip = *hp, i = 0; ip != 0 && i < 8; ip = ip->hnext, i++){
+    if(ip->dev == dev && ip->inum == inum && iref(ip) > 0){
+      if(ip->dev == dev && ip->inum == inum)
+        return ip;
+      irele(ip);
+      break;
+    }
+  }
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = *hp; ip != 0; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(iref(ip) == 0){
+        // Unreferenced: take it off the LRU list.
+        ip->lprev->lnext = ip->lnext;
+        ip->lnext->lprev = ip->lprev;
+        xchg((uint*)&ip->ref, 1);
+      }
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
+  // Grow the cache, or recycle the least recently used entry.
+  if(icache.free == 0 && icache.n < NINODEMAX && (page = kalloc()) != 0){
+    memset(page, 0, PGSIZE);
+    ifree((struct inode*)page, PGSIZE / sizeof(*ip));
+  }
+  if((ip = icache.free) != 0){
+    icache.free = ip->hnext;
+  } else {
+    ip = icache.lru.lprev;
+    if(ip == &icache.lru)
+      panic("iget: no inodes");
+    ip->lprev->lnext = ip->lnext;
+    ip->lnext->lprev = ip->lprev;
+    for(hp = ihash(ip->dev, ip->inum); *hp != ip; hp = &(*hp)->hnext)
+      ;
+    *hp = ip->hnext;
+    hp = ihash(dev, inum);
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
-  ip->ref = 1;
   ip->valid = 0;
+  ip->hnext = *hp;
+  *hp = ip;
+  xchg((uint*)&ip->ref, 1);  // after dev and inum, for iget() without lock
   release(&icache.lock);
 
   return ip;
@@ -276,9 +461,8 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
+  if(iref(ip) == 0)
+    panic("idup");
   return ip;
 }
 
@@ -305,6 +489,7 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->goal = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -333,11 +518,10 @@ iput(struct inode *ip)
 {
   acquiresleep(&ip->lock);
   if(ip->valid && ip->nlink == 0){
-    acquire(&icache.lock);
-    int r = ip->ref;
-    release(&icache.lock);
-    if(r == 1){
+    if(ip->ref == 1){
       // inode has no links and no other references: truncate and free.
+      if(ip->type == T_DIR)
+        dcachepurge(ip);
       itrunc(ip);
       ip->type = 0;
       iupdate(ip);
@@ -346,9 +530,7 @@ iput(struct inode *ip)
   }
   releasesleep(&ip->lock);
 
-  acquire(&icache.lock);
-  ip->ref--;
-  release(&icache.lock);
+  irele(ip);
 }
 
 // Common idiom: unlock, then put.
@@ -365,40 +547,103 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The last NDINDIRECT
+// blocks are reached through the double-indirect block
+// ip->addrs[NDIRECT+1], which lists NINDIRECT indirect blocks.
+//
+// New blocks are allocated right after the last block allocated
+// for the inode, ip->goal, if it is free, so that a file written
+// sequentially is laid out contiguously.
 
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// Allocate a block for inode ip.
+static uint
+iballoc(struct inode *ip)
+{
+  uint addr;
+
+  addr = balloc(ip->dev, ip->goal);
+  ip->goal = addr + 1;
+  return addr;
+}
+
+// Return entry i of the block-address block at addr,
+// allocating a block for it if necessary and alloc is set.
 static uint
-bmap(struct inode *ip, uint bn)
+bmapind(struct inode *ip, uint addr, uint i, int alloc)
 {
-  uint addr, *a;
+  uint *a;
   struct buf *bp;
 
+  if(addr == 0)
+    return 0;
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0 && alloc){
+    a[i] = addr = iballoc(ip);
+    log_write(bp);
+  }
+  brelse(bp);
+  return addr;
+}
+
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one if alloc is
+// set and otherwise returns 0 (a hole in a hashed directory).
+static uint
+bmap(struct inode *ip, uint bn, int alloc)
+{
+  uint addr;
+
   if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[bn]) == 0 && alloc)
+      ip->addrs[bn] = addr = iballoc(ip);
     return addr;
   }
   bn -= NDIRECT;
 
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
-    }
-    brelse(bp);
-    return addr;
+    if((addr = ip->addrs[NDIRECT]) == 0 && alloc)
+      ip->addrs[NDIRECT] = addr = iballoc(ip);
+    return bmapind(ip, addr, bn, alloc);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Double-indirect block, then the indirect block it lists.
+    if((addr = ip->addrs[NDIRECT+1]) == 0 && alloc)
+      ip->addrs[NDIRECT+1] = addr = iballoc(ip);
+    addr = bmapind(ip, addr, bn / NINDIRECT, alloc);
+    return bmapind(ip, addr, bn % NINDIRECT, alloc);
   }
 
   panic("bmap: out of range");
 }
 
+// Free the block-address block at addr and the blocks it
+// lists; depth 1 frees indirect blocks listed by a
+// double-indirect block.
+static void
+itruncind(uint dev, uint addr, int depth)
+{
+  int j;
+  struct buf *bp;
+  uint *a;
+
+  bp = bread(dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j] == 0)
+      continue;
+    if(depth > 0)
+      itruncind(dev, a[j], depth-1);
+    else
+      bfree(dev, a[j]);
+  }
+  brelse(bp);
+  bfree(dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
@@ -407,10 +652,9 @@ bmap(struct inode *ip, uint bn)
 static void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
 
+  textinval(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -419,18 +663,17 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
-    }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
+    itruncind(ip->dev, ip->addrs[NDIRECT], 0);
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    itruncind(ip->dev, ip->addrs[NDIRECT+1], 1);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
   ip->size = 0;
+  ip->goal = 0;
   iupdate(ip);
 }
 
@@ -452,7 +695,7 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addr;
   struct buf *bp;
 
   if(ip->type == T_DEV){
@@ -467,8 +710,12 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
+    if((addr = bmap(ip, off/BSIZE, 0)) == 0){
+      memset(dst, 0, m);  // hole
+      continue;
+    }
+    bp = bread(ip->dev, addr);
     memmove(dst, bp->data + off%BSIZE, m);
     brelse(bp);
   }
@@ -494,9 +741,10 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  textinval(ip);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    bp = bread(ip->dev, bmap(ip, off/BSIZE, 1));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
     log_write(bp);
@@ -510,6 +758,54 @@ writei(struct inode *ip, char *src, uint off, uint n)
   return n;
 }
 
+// Copy n bytes of file src, from offset soff, to file dst at
+// offset doff, straight from one cached block to the other.
+// Whole blocks of a hole stay holes. Stops at the end of src;
+// returns the number of bytes copied.
+// Caller must hold both locks (once, if src == dst) and must
+// not let the ranges overlap.
+int
+copyi(struct inode *src, uint soff, struct inode *dst, uint doff, uint n)
+{
+  uint tot, m, addr;
+  struct buf *sp, *dp;
+
+  if(src->type != T_FILE || dst->type != T_FILE)
+    return -1;
+  if(soff > src->size || doff > dst->size || doff + n < doff)
+    return -1;
+  if(soff + n > src->size)
+    n = src->size - soff;
+  if(doff + n > MAXFILE*BSIZE)
+    return -1;
+  textinval(dst);
+
+  for(tot=0; tot<n; tot+=m, soff+=m, doff+=m){
+    m = min(n - tot, min(BSIZE - soff%BSIZE, BSIZE - doff%BSIZE));
+    addr = bmap(src, soff/BSIZE, 0);
+    if(addr == 0 && m == BSIZE && bmap(dst, doff/BSIZE, 0) == 0)
+      continue;  // hole to hole
+    dp = bread(dst->dev, bmap(dst, doff/BSIZE, 1));
+    if(addr == 0)
+      memset(dp->data + doff%BSIZE, 0, m);
+    else if(addr == dp->blockno)  // within one block of one file
+      memmove(dp->data + doff%BSIZE, dp->data + soff%BSIZE, m);
+    else {
+      sp = bread(src->dev, addr);
+      memmove(dp->data + doff%BSIZE, sp->data + soff%BSIZE, m);
+      brelse(sp);
+    }
+    log_write(dp);
+    brelse(dp);
+  }
+
+  if(n > 0 && doff > dst->size){
+    dst->size = doff;
+    iupdate(dst);
+  }
+  return n;
+}
+
 //PAGEBREAK!
 // Directories
 
@@ -519,32 +815,193 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Hash of a directory entry name; must match mkfs.c.
+static uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261U;
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// Name lookup cache.
+//
+// dcache remembers the results of dirlookup(): which inode,
+// and at what offset, a name refers to in a directory, or that
+// the name is not there (inum 0). It is a direct-mapped table
+// indexed by a hash of (dev, directory inum, name). An entry
+// changes only while its directory is locked: dirlookup() and
+// dirlink() fill it in, unlink() calls dcacheinval(), and freeing
+// a directory's inode drops all of its entries.
+
+struct dentry {
+  uint dev;
+  uint dinum;       // directory inode number; 0 if unused
+  uint inum;        // inode number for name; 0 if not in directory
+  uint off;         // byte offset of the entry in the directory
+  char name[DIRSIZ];
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry dentry[NDENTRY];
+  uint hits;
+  uint misses;
+} dcache;
+
+static void
+dcacheinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static struct dentry*
+dcachehash(uint dev, uint dinum, char *name)
+{
+  return &dcache.dentry[(dirhash(name) ^ dinum*2654435761U ^ dev) % NDENTRY];
+}
+
+// Look up name in directory dp in the cache.
+// Returns 1 and sets *pinum and *poff on a hit.
+static int
+dcacheget(struct inode *dp, char *name, uint *pinum, uint *poff)
+{
+  struct dentry *de;
+  int hit;
+
+  acquire(&dcache.lock);
+  de = dcachehash(dp->dev, dp->inum, name);
+  hit = de->dinum == dp->inum && de->dev == dp->dev &&
+        namecmp(de->name, name) == 0;
+  if(hit){
+    *pinum = de->inum;
+    *poff = de->off;
+    dcache.hits++;
+  } else
+    dcache.misses++;
+  release(&dcache.lock);
+  return hit;
+}
+
+// Remember that name in directory dp is inode inum (0 if
+// name is not there), at offset off.
+static void
+dcacheput(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *de;
+
+  acquire(&dcache.lock);
+  de = dcachehash(dp->dev, dp->inum, name);
+  de->dev = dp->dev;
+  de->dinum = dp->inum;
+  de->inum = inum;
+  de->off = off;
+  strncpy(de->name, name, DIRSIZ);
+  release(&dcache.lock);
+}
+
+// Forget name in directory dp, which the caller is removing.
+// Caller must hold dp->lock.
+void
+dcacheinval(struct inode *dp, char *name)
+{
+  dcacheput(dp, name, 0, 0);
+}
+
+// Forget every name in directory dp, which is being freed.
+static void
+dcachepurge(struct inode *dp)
+{
+  struct dentry *de;
+
+  acquire(&dcache.lock);
+  for(de = dcache.dentry; de < dcache.dentry + NDENTRY; de++)
+    if(de->dinum == dp->inum && de->dev == dp->dev)
+      de->dinum = 0;
+  release(&dcache.lock);
+}
+
+// Copy the cache's hit and miss counts to *hits and *misses.
+void
+dcachestat(uint *hits, uint *misses)
+{
+  acquire(&dcache.lock);
+  *hits = dcache.hits;
+  *misses = dcache.misses;
+  release(&dcache.lock);
+}
+
+// Look for name in directory block bn of dp.
+// If found, set *pinum and *poff and return 1.
+static int
+dirscan(struct inode *dp, uint bn, char *name, uint *pinum, uint *poff)
+{
+  struct buf *bp;
+  struct dirent *de;
+  uint addr, n;
+
+  if((addr = bmap(dp, bn, 0)) == 0)
+    return 0;
+  n = min(BSIZE, dp->size - bn*BSIZE) / sizeof(*de);
+  bp = bread(dp->dev, addr);
+  for(de = (struct dirent*)bp->data; de < (struct dirent*)bp->data + n; de++){
+    if(de->inum == 0)
+      continue;
+    if(namecmp(name, de->name) == 0){
+      *pinum = de->inum;
+      *poff = bn*BSIZE + (uint)((char*)de - (char*)bp->data);
+      brelse(bp);
+      return 1;
+    }
+  }
+  brelse(bp);
+  return 0;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// A hashed directory's bucket for name is searched first,
+// then the entries from before it was hashed.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint bn, nlinear, inum, off;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
-    }
+  if(dcacheget(dp, name, &inum, &off)){
+    if(inum == 0)
+      return 0;
+    goto found;
   }
 
+  nlinear = (dp->size + BSIZE - 1) / BSIZE;
+  if(dp->major == DIR_HASHED){
+    nlinear = dp->minor;
+    bn = nlinear + dirhash(name) % NDIRBUCKET;
+    for(; bn*BSIZE < dp->size; bn += NDIRBUCKET)
+      if(dirscan(dp, bn, name, &inum, &off))
+        goto found;
+  }
+  for(bn = 0; bn < nlinear; bn++)
+    if(dirscan(dp, bn, name, &inum, &off))
+      goto scanned;
+  dcacheput(dp, name, 0, 0);
   return 0;
+
+scanned:
+  dcacheput(dp, name, inum, off);
+found:
+  if(poff)
+    *poff = off;
+  return iget(dp->dev, inum);
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
@@ -552,8 +1009,10 @@ int
 dirlink(struct inode *dp, char *name, uint inum)
 {
   int off;
-  struct dirent de;
+  uint bn;
+  struct dirent de, *d;
   struct inode *ip;
+  struct buf *bp;
 
   // Check that name is not present.
   if((ip = dirlookup(dp, name, 0)) != 0){
@@ -561,20 +1020,50 @@ dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  if(dp->major != DIR_HASHED){
+    // Look for an empty dirent.
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink read");
+      if(de.inum == 0)
+        break;
+    }
+    if(off < dp->size || off + sizeof(de) <= DIRLINEAR*BSIZE){
+      strncpy(de.name, name, DIRSIZ);
+      de.inum = inum;
+      if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink");
+      dcacheput(dp, name, inum, off);
+      return 0;
+    }
+    // Full: hash new entries, keeping the old ones where they are.
+    dp->major = DIR_HASHED;
+    dp->minor = (dp->size + BSIZE - 1) / BSIZE;
+    iupdate(dp);
   }
 
-  strncpy(de.name, name, DIRSIZ);
-  de.inum = inum;
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-    panic("dirlink");
-
-  return 0;
+  // Look for an empty dirent in name's bucket, growing it
+  // by a block if it is full.
+  bn = dp->minor + dirhash(name) % NDIRBUCKET;
+  for(;; bn += NDIRBUCKET){
+    if(bn >= MAXFILE)
+      return -1;
+    bp = bread(dp->dev, bmap(dp, bn, 1));
+    for(d = (struct dirent*)bp->data; d < (struct dirent*)(bp->data + BSIZE); d++){
+      if(d->inum == 0){
+        strncpy(d->name, name, DIRSIZ);
+        d->inum = inum;
+        log_write(bp);
+        dcacheput(dp, name, inum, bn*BSIZE + (uint)((char*)d - (char*)bp->data));
+        brelse(bp);
+        if((bn+1)*BSIZE > dp->size)
+          dp->size = (bn+1)*BSIZE;
+        iupdate(dp);
+        return 0;
+      }
+    }
+    brelse(bp);
+  }
 }
 
 //PAGEBREAK!
@@ -668,3 +1157,128 @@ nameiparent(char *path, char *name)
 {
   return namex(path, 1, name);
 }
+
+// Is directory a, or an ancestor of it, the directory d?
+// Follows ".." up from d; neither may be locked.
+static int
+isancestor(struct inode *a, struct inode *d)
+{
+  struct inode *ip, *next;
+  int r;
+
+  ip = idup(d);
+  while(ip != a && ip->inum != ROOTINO){
+    ilock(ip);
+    next = dirlookup(ip, "..", 0);
+    iunlockput(ip);
+    if(next == 0)
+      return 0;
+    ip = next;
+  }
+  r = ip == a;
+  iput(ip);
+  return r;
+}
+
+// Move the directory entry old to new, or into new if new is
+// a directory, by relinking it: the inode and its blocks are
+// not touched, except a directory's ".." entry. The caller's
+// transaction makes the move atomic.
+int
+rename(char *old, char *new)
+{
+  char sname[DIRSIZ], dname[DIRSIZ];
+  struct inode *sp, *dp, *ip, *tp;
+  struct dirent de;
+  uint off, doff;
+  int r;
+
+  if((sp = nameiparent(old, sname)) == 0)
+    return -1;
+  if(namecmp(sname, ".") == 0 || namecmp(sname, "..") == 0){
+    iput(sp);
+    return -1;
+  }
+  if((dp = namei(new)) != 0){
+    ilock(dp);
+    if(dp->type != T_DIR){
+      iunlockput(dp);
+      iput(sp);
+      return -1;
+    }
+    iunlock(dp);
+    memmove(dname, sname, DIRSIZ);
+  } else if((dp = nameiparent(new, dname)) == 0){
+    iput(sp);
+    return -1;
+  }
+
+  r = -1;
+  ip = 0;
+  acquiresleep(&renamelock);
+  if(sp->dev != dp->dev)
+    goto out;
+  ilock(sp);
+  ip = dirlookup(sp, sname, 0);
+  iunlock(sp);
+  // A directory cannot move into itself or below itself.
+  if(ip == 0 || ip == dp || isancestor(ip, dp))
+    goto out;
+
+  // Lock the two directories, an ancestor before its
+  // descendant, as create() and unlink() do; then the entry.
+  if(sp == dp)
+    ilock(sp);
+  else if(isancestor(dp, sp)){
+    ilock(dp);
+    ilock(sp);
+  } else {
+    ilock(sp);
+    ilock(dp);
+  }
+  if((tp = dirlookup(sp, sname, &off)) != ip){
+    // Unlinked (and perhaps replaced) meanwhile.
+    if(tp)
+      iput(tp);
+    goto unlock;
+  }
+  iput(tp);
+  ilock(ip);
+
+  if(dirlink(dp, dname, ip->inum) < 0){
+    iunlock(ip);
+    goto unlock;
+  }
+  memset(&de, 0, sizeof(de));
+  if(writei(sp, (char*)&de, off, sizeof(de)) != sizeof(de))
+    panic("rename: writei");
+  dcacheinval(sp, sname);
+  if(ip->type == T_DIR && sp != dp){
+    if((tp = dirlookup(ip, "..", &doff)) == 0)
+      panic("rename: no ..");
+    iput(tp);
+    strncpy(de.name, "..", DIRSIZ);
+    de.inum = dp->inum;
+    if(writei(ip, (char*)&de, doff, sizeof(de)) != sizeof(de))
+      panic("rename: writei ..");
+    dcacheput(ip, "..", dp->inum, doff);
+    sp->nlink--;
+    iupdate(sp);
+    dp->nlink++;
+    iupdate(dp);
+  }
+  iunlock(ip);
+  r = 0;
+
+unlock:
+  iunlock(sp);
+  if(dp != sp)
+    iunlock(dp);
+out:
+  releasesleep(&renamelock);
+  if(ip)
+    iput(ip);
+  iput(sp);
+  iput(dp);
+  return r;
+}
@@ -21,18 +21,19 @@ struct superblock {
   uint bmapstart;    // Block number of first free map block
 };
 
-#define NDIRECT 12
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
 // On-disk inode structure
 struct dinode {
   short type;           // File type
-  short major;          // Major device number (T_DEV only)
-  short minor;          // Minor device number (T_DEV only)
+  short major;          // Major device number (T_DEV); DIR_HASHED (T_DIR)
+  short minor;          // Minor device number (T_DEV); see DIR_HASHED
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+2];   // Data block addresses
 };
 
 // Inodes per block.
@@ -50,6 +51,17 @@ struct dinode {
 // Directory is a file containing a sequence of dirent structures.
 #define DIRSIZ 14
 
+// A directory that outgrows DIRLINEAR blocks becomes hashed:
+// its major is set to DIR_HASHED and its minor to the number of
+// blocks it had (whose entries stay where they are). A new
+// entry goes in bucket dirhash(name) % NDIRBUCKET, made up of
+// file blocks minor+bucket, minor+bucket+NDIRBUCKET, ...,
+// each allocated when the previous one is full. Blocks of
+// other buckets in between may be holes.
+#define DIRLINEAR   2
+#define DIR_HASHED  1
+#define NDIRBUCKET  32
+
 struct dirent {
   ushort inum;
   char name[DIRSIZ];
@@ -0,0 +1,151 @@
+// Lock contention benchmark. Prints the ticks taken for:
+//   spin     nthreads threads each adding to a shared counter
+//            n times under a spin lock
+//   mutex    the same under a futex mutex
+//   cond     two threads taking turns n times with a mutex
+//            and condition variable
+//   shm      nthreads processes adding to a counter in
+//            open_sharedmem() memory under a mutex there
+//
+// usage: futexbench [n [nthreads]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define SHMID 7
+
+int n, nthreads;
+volatile uint count;
+lock_t spin;
+mutex_t mu;
+cond_t cv;
+volatile int turn;
+
+struct shared {
+  mutex_t mu;
+  uint count;
+};
+
+static void
+check(char *what, uint got, uint want, int t0)
+{
+  if(got != want){
+    printf(2, "futexbench: %s: count %d, want %d\n", what, got, want);
+    exit();
+  }
+  printf(1, "futexbench: %s %d ticks\n", what, uptime() - t0);
+}
+
+static void
+spinner(void *arg1, void *arg2)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    lock_acquire(&spin);
+    count++;
+    lock_release(&spin);
+  }
+  exit();
+}
+
+static void
+locker(void *arg1, void *arg2)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    mutex_lock(&mu);
+    count++;
+    mutex_unlock(&mu);
+  }
+  exit();
+}
+
+// Wait for turn == me, then hand it to the other thread.
+static void
+pingpong(void *arg1, void *arg2)
+{
+  int i, me;
+
+  me = (int)arg1;
+  for(i = 0; i < n; i++){
+    mutex_lock(&mu);
+    while(turn != me)
+      cond_wait(&cv, &mu);
+    turn = !me;
+    count++;
+    cond_signal(&cv);
+    mutex_unlock(&mu);
+  }
+  exit();
+}
+
+static void
+threads(char *what, void (*fn)(void*, void*), int nt)
+{
+  int i, t0;
+
+  count = 0;
+  t0 = uptime();
+  for(i = 0; i < nt; i++)
+    if(thread_create(fn, (void*)i, 0) < 0){
+      printf(2, "futexbench: thread_create failed\n");
+      exit();
+    }
+  for(i = 0; i < nt; i++)
+    thread_join();
+  check(what, count, n * nt, t0);
+}
+
+static void
+processes(void)
+{
+  struct shared *s;
+  int i, j, t0;
+
+  if((s = (struct shared*)open_sharedmem(SHMID)) == (struct shared*)-1){
+    printf(2, "futexbench: open_sharedmem failed\n");
+    exit();
+  }
+  mutex_init(&s->mu);
+  s->count = 0;
+  t0 = uptime();
+  for(i = 0; i < nthreads; i++){
+    if(fork() == 0){
+      for(j = 0; j < n; j++){
+        mutex_lock(&s->mu);
+        s->count++;
+        mutex_unlock(&s->mu);
+      }
+      exit();
+    }
+  }
+  for(i = 0; i < nthreads; i++)
+    wait();
+  check("shm", s->count, n * nthreads, t0);
+  close_sharedmem(s);
+}
+
+int
+main(int argc, char *argv[])
+{
+  n = argc > 1 ? atoi(argv[1]) : 20000;
+  nthreads = argc > 2 ? atoi(argv[2]) : 4;
+  if(n <= 0 || nthreads <= 0){
+    printf(2, "usage: futexbench [n [nthreads]]\n");
+    exit();
+  }
+  lock_init(&spin);
+  mutex_init(&mu);
+  cond_init(&cv);
+
+  printf(1, "futexbench: %d threads, %d each\n", nthreads, n);
+  threads("spin", spinner, nthreads);
+  threads("mutex", locker, nthreads);
+  turn = 0;
+  threads("cond", pingpong, 2);
+  processes();
+  exit();
+}
@@ -8,29 +8,17 @@ char buf[1024];
 int match(char*, char*);
 
 void
-grep(char *pattern, int fd)
+grep(char *pattern, FILE *f)
 {
-  int n, m;
-  char *p, *q;
+  char *q;
 
-  m = 0;
-  while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
-    m += n;
-    buf[m] = '\0';
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
+  while(fgets(buf, sizeof(buf), f) != 0){
+    if((q = strchr(buf, '\n')) != 0)
       *q = 0;
-      if(match(pattern, p)){
+    if(match(pattern, buf)){
+      if(q)
         *q = '\n';
-        write(1, p, q+1 - p);
-      }
-      p = q+1;
-    }
-    if(p == buf)
-      m = 0;
-    if(m > 0){
-      m -= p - buf;
-      memmove(buf, p, m);
+      fputs(buf, stdout);
     }
   }
 }
@@ -38,7 +26,8 @@ grep(char *pattern, int fd)
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  FILE *f;
+  int i;
   char *pattern;
 
   if(argc <= 1){
@@ -48,17 +37,17 @@ main(int argc, char *argv[])
   pattern = argv[1];
 
   if(argc <= 2){
-    grep(pattern, 0);
+    grep(pattern, stdin);
     exit();
   }
 
   for(i = 2; i < argc; i++){
-    if((fd = open(argv[i], 0)) < 0){
+    if((f = fopen(argv[i], "r")) == 0){
       printf(1, "grep: cannot open %s\n", argv[i]);
       exit();
     }
-    grep(pattern, fd);
-    close(fd);
+    grep(pattern, f);
+    fclose(f);
   }
   exit();
 }
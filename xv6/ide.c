@@ -1,4 +1,6 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// IDE driver code.
+// Uses bus-master DMA when the controller supports it (the PIIX
+// IDE function that QEMU emulates), and falls back to PIO otherwise.
 
 #include "types.h"
 #include "defs.h"
@@ -12,6 +14,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "pci.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -23,6 +26,29 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
+#define IDE_CMD_RDDMA 0xc8
+#define IDE_CMD_WRDMA 0xca
+
+// Bus-master IDE registers, as offsets from the primary
+// channel's base port (BAR4 of the IDE controller).
+#define BM_CMD        0
+#define BM_STATUS     2
+#define BM_PRDT       4
+#define BM_CMD_START  0x01
+#define BM_CMD_READ   0x08  // transfer from disk to memory
+#define BM_ST_ERR     0x02
+#define BM_ST_INTR    0x04
+
+#define IDE_MAXRUN    32    // max bufs in one multi-block DMA command
+
+// Physical region descriptor: one physically contiguous
+// piece of a DMA transfer. May not cross a 64KB boundary.
+struct prd {
+  uint addr;
+  ushort count;
+  ushort flags;
+};
+#define PRD_EOT       0x8000  // last entry in the table
 
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
@@ -34,6 +60,17 @@ static struct buf *idequeue;
 static int havedisk1;
 static void idestart(struct buf*);
 
+// Bus-master DMA state. iderun is the number of bufs at the head
+// of idequeue covered by the command in flight, and dmarun says
+// whether that command uses DMA. After a DMA error the head buf
+// is retried with PIO (pioretry).
+static int usedma;
+static ushort bmbase;
+static int iderun;
+static int dmarun;
+static int pioretry;
+static struct prd prdt[2*IDE_MAXRUN] __attribute__((aligned(512)));
+
 // Wait for IDE disk to become ready.
 static int
 idewait(int checkerr)
@@ -67,12 +104,64 @@ ideinit(void)
 
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+
+  // Use bus-master DMA if there is a PCI IDE controller
+  // with a bus-master I/O range.
+  struct pcidev d;
+  if(pcifind(PCI_ANY, PCI_ANY, 0x0101, &d) == 0 && (d.bar[4] & 1) &&
+     (d.bar[4] & ~3) != 0){
+    pcienable(&d);
+    bmbase = d.bar[4] & ~3;
+    usedma = 1;
+  }
+  cprintf("ide: %s\n", usedma ? "bus-master dma" : "pio");
+}
+
+// Can b2 be transferred in the same command as b, right after it?
+static int
+ideadjacent(struct buf *b, struct buf *b2)
+{
+  return b2->dev == b->dev && b2->blockno == b->blockno + 1 &&
+         b2->blockno < FSSIZE &&
+         (b2->flags & B_DIRTY) == (b->flags & B_DIRTY);
+}
+
+// Point the bus-master engine at the data of the n bufs
+// starting at b, one or two descriptors per buf.
+static void
+idedmasetup(struct buf *b, int n)
+{
+  struct prd *p;
+  uint pa, len, m;
+  int i;
+
+  p = prdt;
+  for(i = 0; i < n; i++, b = b->qnext){
+    pa = V2P(b->data);
+    for(len = BSIZE; len > 0; len -= m, pa += m, p++){
+      m = 0x10000 - (pa & 0xFFFF);
+      if(m > len)
+        m = len;
+      p->addr = pa;
+      p->count = m;
+      p->flags = 0;
+    }
+  }
+  (p-1)->flags = PRD_EOT;
+
+  outl(bmbase + BM_PRDT, V2P(prdt));
+  outb(bmbase + BM_STATUS, BM_ST_ERR | BM_ST_INTR);  // clear
 }
 
 // Start the request for b.  Caller must hold idelock.
+// With DMA, also take in the bufs queued right behind b that
+// continue it on disk, up to IDE_MAXRUN, as one command.
 static void
 idestart(struct buf *b)
 {
+  struct buf *e;
+  int n;
+
   if(b == 0)
     panic("idestart");
   if(b->blockno >= FSSIZE)
@@ -84,14 +173,31 @@ idestart(struct buf *b)
 
   if (sector_per_block > 7) panic("idestart");
 
+  n = 1;
+  dmarun = usedma && !pioretry;
+  if(dmarun)
+    for(e = b; n < IDE_MAXRUN && e->qnext && ideadjacent(e, e->qnext); e = e->qnext)
+      n++;
+  iderun = n;
+
   idewait(0);
+  if(dmarun)
+    idedmasetup(b, n);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, n * sector_per_block);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
+  if(dmarun){
+    if(b->flags & B_DIRTY){
+      outb(0x1f7, IDE_CMD_WRDMA);
+      outb(bmbase + BM_CMD, BM_CMD_START);
+    } else {
+      outb(0x1f7, IDE_CMD_RDDMA);
+      outb(bmbase + BM_CMD, BM_CMD_READ | BM_CMD_START);
+    }
+  } else if(b->flags & B_DIRTY){
     outb(0x1f7, write_cmd);
     outsl(0x1f0, b->data, BSIZE/4);
   } else {
@@ -104,6 +210,7 @@ void
 ideintr(void)
 {
   struct buf *b;
+  int i;
 
   // First queued buffer is the active request.
   acquire(&idelock);
@@ -112,16 +219,41 @@ ideintr(void)
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
 
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  if(dmarun){
+    if((inb(bmbase + BM_STATUS) & BM_ST_INTR) == 0){
+      // Not ours; the transfer is still running.
+      release(&idelock);
+      return;
+    }
+    outb(bmbase + BM_CMD, 0);  // stop the engine
+    i = idewait(1) < 0 || (inb(bmbase + BM_STATUS) & BM_ST_ERR);
+    outb(bmbase + BM_STATUS, BM_ST_ERR | BM_ST_INTR);
+    if(i){
+      // Nothing in the run can be trusted: do it again, the
+      // first buf by PIO and the rest as usual.
+      cprintf("ide: dma error on block %d, retrying with pio\n", b->blockno);
+      pioretry = 1;
+      idestart(idequeue);
+      release(&idelock);
+      return;
+    }
+  }
+  pioretry = 0;
+
+  for(i = 0; i < iderun; i++){
+    b = idequeue;
+    idequeue = b->qnext;
+
+    // Read data if needed.
+    if(!dmarun && !(b->flags & B_DIRTY) && idewait(1) >= 0)
+      insl(0x1f0, b->data, BSIZE/4);
 
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+    // Wake process waiting for this buf.
+    b->flags |= B_VALID;
+    b->flags &= ~B_DIRTY;
+    wakeup(b);
+  }
 
   // Start disk on next buf in queue.
   if(idequeue != 0)
@@ -131,38 +263,53 @@ ideintr(void)
 }
 
 //PAGEBREAK!
-// Sync buf with disk.
+// Sync n bufs with disk.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 // Else if B_VALID is not set, read buf from disk, set B_VALID.
+// The bufs are queued back to back, so runs of consecutive
+// blocks are transferred with a single command.
 void
-iderw(struct buf *b)
+iderwv(struct buf **bs, int n)
 {
   struct buf **pp;
+  int i;
 
-  if(!holdingsleep(&b->lock))
-    panic("iderw: buf not locked");
-  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("iderw: nothing to do");
-  if(b->dev != 0 && !havedisk1)
-    panic("iderw: ide disk 1 not present");
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("iderw: buf not locked");
+    if((bs[i]->flags & (B_VALID|B_DIRTY)) == B_VALID)
+      panic("iderw: nothing to do");
+    if(bs[i]->dev != 0 && !havedisk1)
+      panic("iderw: ide disk 1 not present");
+  }
+  if(n <= 0)
+    return;
 
   acquire(&idelock);  //DOC:acquire-lock
 
-  // Append b to idequeue.
-  b->qnext = 0;
+  // Append bs to idequeue.
   for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
     ;
-  *pp = b;
+  for(i = 0; i < n; i++){
+    bs[i]->qnext = 0;
+    *pp = bs[i];
+    pp = &bs[i]->qnext;
+  }
 
   // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
-
-  // Wait for request to finish.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
-    sleep(b, &idelock);
-  }
+  if(idequeue == bs[0])
+    idestart(bs[0]);
 
+  // Wait for requests to finish.
+  for(i = 0; i < n; i++)
+    while((bs[i]->flags & (B_VALID|B_DIRTY)) != B_VALID)
+      sleep(bs[i], &idelock);
 
   release(&idelock);
 }
+
+void
+iderw(struct buf *b)
+{
+  iderwv(&b, 1);
+}
@@ -73,3 +73,13 @@ ioapicenable(int irq, int cpunum)
   ioapicwrite(REG_TABLE+2*irq, T_IRQ0 + irq);
   ioapicwrite(REG_TABLE+2*irq+1, cpunum << 24);
 }
+
+// Like ioapicenable, but deliver irq on the vector of
+// vecirq. Lets a PCI device, whose interrupt line is only
+// known at run time, use the handler trap.c has for vecirq.
+void
+ioapicroute(int irq, int vecirq, int cpunum)
+{
+  ioapicwrite(REG_TABLE+2*irq, T_IRQ0 + vecirq);
+  ioapicwrite(REG_TABLE+2*irq+1, cpunum << 24);
+}
@@ -0,0 +1,97 @@
+// Print kernel spin lock statistics, busiest first: per lock
+// name, the acquisitions, how many had to spin, the cycles
+// spent spinning (in units of 1024) and the longest hold in
+// cycles.
+//
+// usage: lockstat            print since boot or last reset
+//        lockstat -r         reset
+//        lockstat cmd [arg...]
+//                            reset, run cmd, print
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "lockstat.h"
+
+struct lockstat ls[NLOCKCLASS];
+
+// Print s left-justified in w columns.
+static void
+col(char *s, int w)
+{
+  printf(1, "%s", s);
+  for(w -= strlen(s); w > 0; w--)
+    printf(1, " ");
+}
+
+// Print n right-justified in w columns.
+static void
+num(uint n, int w)
+{
+  char s[12];
+  int i;
+
+  i = sizeof(s) - 1;
+  s[i] = 0;
+  do {
+    s[--i] = '0' + n % 10;
+    n /= 10;
+  } while(n > 0);
+  for(w -= sizeof(s) - 1 - i; w > 0; w--)
+    printf(1, " ");
+  printf(1, "%s", s + i);
+}
+
+static void
+print(void)
+{
+  struct lockstat t;
+  int i, j, n;
+
+  if((n = lockstat(ls, NLOCKCLASS)) < 0){
+    printf(2, "lockstat: lockstat failed\n");
+    exit();
+  }
+  for(i = 1; i < n; i++){
+    t = ls[i];
+    for(j = i; j > 0 && ls[j-1].spink < t.spink; j--)
+      ls[j] = ls[j-1];
+    ls[j] = t;
+  }
+  col("lock", 16);
+  col("   acquires", 11);
+  col("  contended", 11);
+  col("   spin Kcyc", 12);
+  col("   max hold", 11);
+  printf(1, "\n");
+  for(i = 0; i < n; i++){
+    if(ls[i].nacquire == 0)
+      continue;
+    col(ls[i].name, 16);
+    num(ls[i].nacquire, 11);
+    num(ls[i].ncontend, 11);
+    num(ls[i].spink, 12);
+    num(ls[i].maxhold, 11);
+    printf(1, "\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc == 1){
+    print();
+    exit();
+  }
+  lockstat(0, 0);
+  if(strcmp(argv[1], "-r") == 0)
+    exit();
+  if(spawn(argv[1], argv + 1, 0, 0) < 0){
+    printf(2, "lockstat: cannot run %s\n", argv[1]);
+    exit();
+  }
+  wait();
+  print();
+  exit();
+}
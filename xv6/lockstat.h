@@ -0,0 +1,10 @@
+// Contention statistics for a class of spin locks: all the
+// locks initialized with the same name. Filled in by
+// lockstat().
+struct lockstat {
+  char name[16];
+  uint nacquire;     // acquisitions
+  uint ncontend;     // acquisitions that had to spin
+  uint spink;        // cycles spent spinning, in units of 1024
+  uint maxhold;      // longest time held, in cycles
+};
@@ -19,19 +19,58 @@
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
+// begin_op() reserves MAXOPBLOCKS blocks of the transaction;
+// an operation that writes more, like a large write(), uses
+// begin_opn()/end_opn() to reserve as many as it needs.
 //
-// The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
+// How many blocks a transaction may hold is decided at boot
+// from the size of the on-disk log (up to LOGSIZE, the most
+// a header block can describe), and can be lowered at run
+// time with logbudget().
+//
+// Group commit: the last end_op() of a transaction copies the
+// transaction's blocks into a private commit buffer and then
+// starts a new, empty transaction before writing anything to
+// disk. New FS system calls therefore run while the previous
+// transaction is being written, and all of them are committed
+// together, as the next group, once it is done.
+//
+// The log is a physical re-do log containing disk blocks,
+// written as a sequence of commit records:
+//   log super block: magic, sequence number of the first record
+//   record: header (magic, seq, checksum, n, block #s), n blocks
+//   record: header, blocks
 //   ...
-// Log appends are synchronous.
+// A record is written with one disk request, header and blocks
+// together; the checksum over both tells recovery whether all of
+// it reached the disk, so the header is only written once.
+//
+// Checkpointing is lazy: committed blocks are not copied to
+// their home locations after each commit, but stay pinned in
+// the buffer cache (which holds their latest contents) while
+// further records are appended. Only when the log or the set
+// of pinned blocks might not have room for another transaction
+// are the distinct committed blocks installed, each once no
+// matter how many records rewrote it, and the log restarted
+// by writing the log super block with the next sequence number.
+// Recovery replays records from the start of the log as long as
+// their sequence numbers follow on from the super block's and
+// their checksums match.
+
+#define LOGMAGIC  0x786c6f67  // "xlog"
+#define NDIRTY    (2*LOGSIZE)  // max committed blocks awaiting install
 
-// Contents of the header block, used for both the on-disk header block
+struct logsuper {
+  uint magic;
+  uint seq;        // sequence number of the first record
+};
+
+// Commit record header, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
+  uint magic;
+  uint seq;
+  uint cksum;      // over seq, n, block[] and the n blocks
   int n;
   int block[LOGSIZE];
 };
@@ -41,169 +80,398 @@ struct log {
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // blocks reserved by them
+  int txsize;      // most blocks in one transaction, for this log
+  int budget;      // blocks a transaction may reserve, <= txsize
+  uint ncommit;    // records written since boot
+  int copying;     // commit() is copying out the transaction, please wait.
+  int committing;  // a commit is being written to disk.
   int dev;
-  struct logheader lh;
+  struct logheader lh;  // transaction being built
+
+  // Owned by the committing process.
+  uint seq;        // sequence number of the next record
+  int head;        // where the next record goes, relative to start
+  int ndirty;      // committed blocks not yet installed
+  struct buf *dirty[NDIRTY];  // their pinned cache buffers
 };
 struct log log;
 
+// The record being written to disk: its header and a private
+// copy of each block. These are bufs of their own (not in bcache)
+// so they can be handed to the disk driver directly while new
+// transactions modify the cached blocks.
+static struct {
+  struct logheader lh;
+  struct buf hdr;
+  struct buf copy[LOGSIZE];
+  struct buf *cached[LOGSIZE];
+} cbuf;
+
 static void recover_from_log(void);
 static void commit();
 
 void
 initlog(int dev)
 {
+  int i;
+
   if (sizeof(struct logheader) >= BSIZE)
     panic("initlog: too big logheader");
 
   struct superblock sb;
   initlock(&log.lock, "log");
+  initsleeplock(&cbuf.hdr.lock, "logcopy");
+  for (i = 0; i < LOGSIZE; i++)
+    initsleeplock(&cbuf.copy[i].lock, "logcopy");
   readsb(dev, &sb);
   log.start = sb.logstart;
   log.size = sb.nlog;
   log.dev = dev;
+  // Room for two records of txsize blocks, so that a
+  // transaction can always be written after the last one.
+  log.txsize = (log.size - 1) / 2 - 1;
+  if (log.txsize > LOGSIZE)
+    log.txsize = LOGSIZE;
+  if (log.txsize < 2*MAXOPBLOCKS)
+    panic("initlog: log too small");
+  log.budget = log.txsize;
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
-static void
-install_trans(void)
+static uint
+log_cksum(struct logheader *lh, struct buf **bs)
 {
-  int tail;
+  uint a, b, *w;
+  int i, j;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
+  a = 1 + lh->seq + lh->n;
+  b = a;
+  for (i = 0; i < lh->n; i++) {
+    a += lh->block[i];
+    b += a;
+    w = (uint*)bs[i]->data;
+    for (j = 0; j < BSIZE/sizeof(uint); j++) {
+      a += w[j];
+      b += a;
+    }
   }
+  return a ^ (b << 16 | b >> 16);
 }
 
-// Read the log header from disk into the in-memory log header
+// Copy the n blocks in bs to their home locations,
+// given by block[].
 static void
-read_head(void)
+install_trans(struct buf **bs, int *block, int n)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  struct buf *t;
+  int i, j;
+
+  // Sorted by block number, so the driver can merge neighbours.
+  for (i = 0; i < n; i++) {
+    t = bs[i];
+    t->blockno = block[i];
+    for (j = i; j > 0 && bs[j-1]->blockno > t->blockno; j--)
+      bs[j] = bs[j-1];
+    bs[j] = t;
   }
-  brelse(buf);
+  bwritev(bs, n);  // write dst to disk
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Write the log super block: the log now starts afresh at
+// the record after it, with sequence number log.seq.
 static void
-write_head(void)
+write_super(void)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
+  struct logsuper *ls = (struct logsuper *) (buf->data);
+
+  memset(buf->data, 0, BSIZE);
+  ls->magic = LOGMAGIC;
+  ls->seq = log.seq;
+  bwrite(buf);
+  brelse(buf);
+  log.head = 1;
+}
+
+// Read the record at log.head into the commit buffer.
+// Returns 0 if it is complete and is the next in sequence.
+static int
+read_record(void)
+{
+  struct buf *bs[LOGSIZE];
+  struct logheader *lh;
+  struct buf *buf;
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+
+  if (log.head + 1 > log.size)
+    return -1;
+  buf = bread(log.dev, log.start+log.head);
+  lh = (struct logheader *) (buf->data);
+  if (lh->magic != LOGMAGIC || lh->seq != log.seq ||
+     lh->n < 1 || lh->n > LOGSIZE || log.head+1+lh->n > log.size) {
+    brelse(buf);
+    return -1;
   }
-  bwrite(buf);
+  memmove(&cbuf.lh, lh, sizeof(cbuf.lh));
   brelse(buf);
+
+  for (i = 0; i < cbuf.lh.n; i++) {
+    struct buf *lbuf = bread(log.dev, log.start+log.head+1+i); // read log block
+    acquiresleep(&cbuf.copy[i].lock);
+    cbuf.copy[i].dev = log.dev;
+    memmove(cbuf.copy[i].data, lbuf->data, BSIZE);
+    brelse(lbuf);
+    bs[i] = &cbuf.copy[i];
+  }
+  if (log_cksum(&cbuf.lh, bs) == cbuf.lh.cksum)
+    return 0;
+  for (i = 0; i < cbuf.lh.n; i++)
+    releasesleep(&cbuf.copy[i].lock);
+  return -1;
 }
 
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct buf *bs[LOGSIZE];
+  struct buf *buf;
+  struct logsuper *ls;
+  int i, n;
+
+  buf = bread(log.dev, log.start);
+  ls = (struct logsuper *) (buf->data);
+  log.seq = ls->magic == LOGMAGIC ? ls->seq : 1;
+  brelse(buf);
+
+  // Replay, in order, every complete record that follows on.
+  n = 0;
+  for (log.head = 1; read_record() == 0; log.head += cbuf.lh.n + 1) {
+    for (i = 0; i < cbuf.lh.n; i++)
+      bs[i] = &cbuf.copy[i];
+    install_trans(bs, cbuf.lh.block, cbuf.lh.n);
+    for (i = 0; i < cbuf.lh.n; i++)
+      releasesleep(&cbuf.copy[i].lock);
+    log.seq++;
+    n++;
+  }
+  if (n > 0)
+    cprintf("log: recovered %d transactions\n", n);
+  write_super(); // clear the log
 }
 
 // called at the start of each FS system call.
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// Start an FS operation that writes at most n blocks.
+// n may exceed the budget (if it was lowered since the
+// caller asked for it); the operation then runs alone.
+void
+begin_opn(int n)
+{
+  if(n < 1 || n > log.txsize)
+    panic("begin_opn");
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.copying){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + log.reserved + n > log.budget &&
+              (log.lh.n > 0 || log.outstanding > 0)){
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
       release(&log.lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
-// commits if this was the last outstanding operation.
 void
 end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
+// called at the end of each FS system call, with the
+// number of blocks passed to begin_opn().
+// commits if this was the last outstanding operation,
+// unless an earlier commit is still being written; its
+// writer then commits this group when it is done.
+void
+end_opn(int n)
 {
   int do_commit = 0;
 
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
+  log.reserved -= n;
+  if(log.outstanding == 0 && !log.committing){
     do_commit = 1;
     log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
+    log.copying = 1;
   }
+  // begin_op() may be waiting for log space,
+  // and decrementing log.outstanding has decreased
+  // the amount of reserved space.
+  wakeup(&log);
   release(&log.lock);
 
-  if(do_commit){
+  while(do_commit){
     // call commit w/o holding locks, since not allowed
     // to sleep with locks.
     commit();
     acquire(&log.lock);
-    log.committing = 0;
+    if(log.outstanding == 0 && log.lh.n > 0){
+      // Operations finished while we were writing: commit
+      // them too, as the next group.
+      log.copying = 1;
+    } else {
+      log.committing = 0;
+      do_commit = 0;
+    }
     wakeup(&log);
     release(&log.lock);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Let new FS system calls start a new, empty transaction.
 static void
-write_log(void)
+open_trans(void)
 {
-  int tail;
+  acquire(&log.lock);
+  log.lh.n = 0;
+  log.copying = 0;
+  wakeup(&log);
+  release(&log.lock);
+}
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+// Copy the blocks of the transaction being built into the
+// commit buffer. No FS system calls are active while
+// log.copying is set.
+static void
+copy_trans(void)
+{
+  int i;
+
+  for (i = 0; i < log.lh.n; i++) {
+    struct buf *from = bread(log.dev, log.lh.block[i]); // cache block
+    acquiresleep(&cbuf.copy[i].lock);
+    cbuf.copy[i].dev = log.dev;
+    memmove(cbuf.copy[i].data, from->data, BSIZE);
+    cbuf.cached[i] = from;  // still pinned by log_write()
+    cbuf.lh.block[i] = log.lh.block[i];
     brelse(from);
-    brelse(to);
   }
+  cbuf.lh.n = log.lh.n;
+}
+
+// Write the commit buffer to the log as one record -- the
+// real commit -- with a single disk request.
+static void
+write_record(void)
+{
+  struct buf *bs[LOGSIZE+1];
+  int i;
+
+  cbuf.lh.magic = LOGMAGIC;
+  cbuf.lh.seq = log.seq;
+  for (i = 0; i < cbuf.lh.n; i++)
+    bs[i+1] = &cbuf.copy[i];
+  cbuf.lh.cksum = log_cksum(&cbuf.lh, bs+1);
+
+  acquiresleep(&cbuf.hdr.lock);
+  cbuf.hdr.dev = log.dev;
+  memset(cbuf.hdr.data, 0, BSIZE);
+  memmove(cbuf.hdr.data, &cbuf.lh, sizeof(cbuf.lh));
+  bs[0] = &cbuf.hdr;
+  for (i = 0; i <= cbuf.lh.n; i++)
+    bs[i]->blockno = log.start + log.head + i;
+  bwritev(bs, cbuf.lh.n + 1);
+  releasesleep(&cbuf.hdr.lock);
+  for (i = 0; i < cbuf.lh.n; i++)
+    releasesleep(&cbuf.copy[i].lock);
+
+  log.head += cbuf.lh.n + 1;
+  log.seq++;
+}
+
+// The committed blocks are now in the log; remember their
+// pinned cache buffers until they are installed. A block
+// that is already waiting needs only one pin.
+static void
+add_dirty(void)
+{
+  int i, j;
+
+  for (i = 0; i < cbuf.lh.n; i++) {
+    for (j = 0; j < log.ndirty; j++)
+      if (log.dirty[j] == cbuf.cached[i])
+        break;
+    if (j < log.ndirty)
+      bunpin(cbuf.cached[i]);
+    else
+      log.dirty[log.ndirty++] = cbuf.cached[i];
+  }
+  cbuf.lh.n = 0;
+}
+
+// Install every committed block at its home location and
+// restart the log. The cache holds exactly the committed
+// contents: callers make sure no transaction is being built.
+static void
+checkpoint(void)
+{
+  static int block[NDIRTY];  // only the committing process is here
+  int i, n;
+
+  n = log.ndirty;
+  for (i = 0; i < n; i++) {
+    bread(log.dev, log.dirty[i]->blockno); // lock cached block
+    block[i] = log.dirty[i]->blockno;
+  }
+  install_trans(log.dirty, block, n);
+  for (i = 0; i < n; i++) {
+    brelse(log.dirty[i]);
+    bunpin(log.dirty[i]);
+  }
+  log.ndirty = 0;
+  write_super();   // Erase the installed records from the log
 }
 
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  int full;
+
+  copy_trans();
+  // Will there be room for another full transaction after
+  // this one? If not, install everything before letting new
+  // operations modify the cache again.
+  full = log.head + (cbuf.lh.n+1) + (log.txsize+1) > log.size ||
+         log.ndirty + cbuf.lh.n + log.txsize > NDIRTY;
+  if (!full)
+    open_trans();    // Take the transaction; new ops may now start
+  if (cbuf.lh.n > 0) {
+    write_record();  // Write header and blocks to the log -- the commit
+    add_dirty();
+    log.ncommit++;
+  }
+  if (full) {
+    checkpoint();
+    open_trans();
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
-// Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// Record the block number and pin the buffer in the cache
+// until the transaction has been installed.
+// commit()/write_record() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -215,7 +483,7 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.txsize)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -226,9 +494,57 @@ log_write(struct buf *b)
       break;
   }
   log.lh.block[i] = b->blockno;
-  if (i == log.lh.n)
+  if (i == log.lh.n) {
+    bpin(b);  // prevent eviction
     log.lh.n++;
-  b->flags |= B_DIRTY; // prevent eviction
+  }
   release(&log.lock);
 }
 
+// Set the number of blocks a transaction may reserve to n,
+// within what the log allows (and at least enough for a
+// write of a few blocks), if n > 0. Returns the budget
+// in effect.
+int
+logbudget(int n)
+{
+  acquire(&log.lock);
+  if (n > 0) {
+    if (n < 2*MAXOPBLOCKS)
+      n = 2*MAXOPBLOCKS;
+    if (n > log.txsize)
+      n = log.txsize;
+    log.budget = n;
+    wakeup(&log);
+  }
+  n = log.budget;
+  release(&log.lock);
+  return n;
+}
+
+// Number of committed blocks whose home locations have not
+// been written yet: disk writes a checkpoint still owes.
+int
+logpending(void)
+{
+  int n;
+
+  acquire(&log.lock);
+  while(log.committing)
+    sleep(&log, &log.lock);
+  n = log.ndirty;
+  release(&log.lock);
+  return n;
+}
+
+// Number of transactions committed since boot.
+int
+logcommits(void)
+{
+  int n;
+
+  acquire(&log.lock);
+  n = log.ncommit;
+  release(&log.lock);
+  return n;
+}
@@ -0,0 +1,78 @@
+// File system transaction throughput benchmark.
+// Several processes create, write, close and unlink small
+// files concurrently; each of those system calls is one log
+// transaction. Prints transactions per second.
+//
+// usage: logbench [nproc] [files-per-proc]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+#define OPS_PER_FILE 4   // open(O_CREATE), write, close, unlink
+
+char data[512];
+
+static void
+worker(int id, int nfiles)
+{
+  char name[16];
+  int i, fd;
+
+  name[0] = 'l';
+  name[1] = 'b';
+  name[2] = 'a' + id;
+  name[4] = 0;
+  for(i = 0; i < nfiles; i++){
+    name[3] = 'a' + i % 26;
+    fd = open(name, O_CREATE | O_RDWR);
+    if(fd < 0){
+      printf(2, "logbench: create %s failed\n", name);
+      exit();
+    }
+    if(write(fd, data, sizeof(data)) != sizeof(data)){
+      printf(2, "logbench: write failed\n");
+      exit();
+    }
+    close(fd);
+    unlink(name);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, nfiles, i, t0, ticks, ntrans;
+
+  nproc = 4;
+  nfiles = 50;
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    nfiles = atoi(argv[2]);
+  if(nproc < 1 || nproc > 26){
+    printf(2, "logbench: nproc must be 1..26\n");
+    exit();
+  }
+
+  memset(data, 'x', sizeof(data));
+  t0 = uptime();
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0){
+      worker(i, nfiles);
+      exit();
+    }
+  }
+  for(i = 0; i < nproc; i++)
+    wait();
+  ticks = uptime() - t0;
+  if(ticks == 0)
+    ticks = 1;
+
+  ntrans = nproc * nfiles * OPS_PER_FILE;
+  printf(1, "logbench: %d procs, %d transactions in %d ticks, %d trans/s\n",
+         nproc, ntrans, ticks, ntrans * 100 / ticks);
+  exit();
+}
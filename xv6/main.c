@@ -30,9 +30,11 @@ main(void)
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
+  textinit();      // program page cache
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  strinit();       // check and time string primitives
   userinit();      // first user process
   sharedMemoryInit();
   mpmain();        // finish this processor's setup
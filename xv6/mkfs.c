@@ -22,7 +22,7 @@
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int nlog = LOGBLOCKS;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -40,6 +40,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void dirlink(uint dinum, char *name, uint inum);
 
 // convert to intel byte order
 ushort
@@ -143,11 +144,7 @@ main(int argc, char *argv[])
       ++argv[i];
 
     inum = ialloc(T_FILE);
-
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, argv[i], DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    dirlink(rootino, argv[i], inum);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -157,10 +154,12 @@ main(int argc, char *argv[])
 
   // fix size of root inode dir
   rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  if(xshort(din.major) != DIR_HASHED){
+    off = xint(din.size);
+    off = ((off/BSIZE) + 1) * BSIZE;
+    din.size = xint(off);
+    winode(rootino, &din);
+  }
 
   balloc(freeblock);
 
@@ -238,20 +237,65 @@ void
 balloc(int used)
 {
   uchar buf[BSIZE];
-  int i;
+  int i, b;
 
   printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < BSIZE*8);
-  bzero(buf, BSIZE);
-  for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  assert(used < nbitmap*BSIZE*8);
+  for(b = 0; b*BSIZE*8 < used; b++){
+    bzero(buf, BSIZE);
+    for(i = 0; i < BSIZE*8 && b*BSIZE*8 + i < used; i++){
+      buf[i/8] = buf[i/8] | (0x1 << (i%8));
+    }
+    printf("balloc: write bitmap block at sector %d\n", sb.bmapstart+b);
+    wsect(sb.bmapstart+b, buf);
   }
-  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
 }
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return entry i of the block-address block at addr,
+// allocating a block for it if necessary and alloc is set.
+uint
+ibmapind(uint addr, uint i, int alloc)
+{
+  uint indirect[NINDIRECT];
+
+  if(addr == 0)
+    return 0;
+  rsect(addr, (char*)indirect);
+  if(indirect[i] == 0 && alloc){
+    indirect[i] = xint(freeblock++);
+    wsect(addr, (char*)indirect);
+  }
+  return xint(indirect[i]);
+}
+
+// Return the address of block fbn of din, allocating it
+// if necessary and alloc is set, like bmap() in fs.c.
+uint
+ibmap(struct dinode *din, uint fbn, int alloc)
+{
+  uint x;
+
+  assert(fbn < MAXFILE);
+  if(fbn < NDIRECT){
+    if(xint(din->addrs[fbn]) == 0 && alloc)
+      din->addrs[fbn] = xint(freeblock++);
+    return xint(din->addrs[fbn]);
+  }
+  fbn -= NDIRECT;
+  if(fbn < NINDIRECT){
+    if(xint(din->addrs[NDIRECT]) == 0 && alloc)
+      din->addrs[NDIRECT] = xint(freeblock++);
+    return ibmapind(xint(din->addrs[NDIRECT]), fbn, alloc);
+  }
+  fbn -= NINDIRECT;
+  if(xint(din->addrs[NDIRECT+1]) == 0 && alloc)
+    din->addrs[NDIRECT+1] = xint(freeblock++);
+  x = ibmapind(xint(din->addrs[NDIRECT+1]), fbn / NINDIRECT, alloc);
+  return ibmapind(x, fbn % NINDIRECT, alloc);
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -259,7 +303,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -268,22 +311,7 @@ iappend(uint inum, void *xp, int n)
   while(n > 0){
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = ibmap(&din, fbn, 1);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -295,3 +323,60 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+// Hash of a directory entry name; must match fs.c.
+uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261U;
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// Add the entry (name, inum) to directory dinum, hashing
+// the directory once it outgrows DIRLINEAR blocks, like
+// dirlink() in fs.c.
+void
+dirlink(uint dinum, char *name, uint inum)
+{
+  struct dinode din;
+  struct dirent de, *d;
+  char buf[BSIZE];
+  uint fbn, x;
+
+  bzero(&de, sizeof(de));
+  de.inum = xshort(inum);
+  strncpy(de.name, name, DIRSIZ);
+
+  rinode(dinum, &din);
+  if(xshort(din.major) != DIR_HASHED){
+    if(xint(din.size) + sizeof(de) <= DIRLINEAR*BSIZE){
+      iappend(dinum, &de, sizeof(de));
+      return;
+    }
+    din.major = xshort(DIR_HASHED);
+    din.minor = xshort((xint(din.size) + BSIZE - 1) / BSIZE);
+  }
+
+  fbn = xshort(din.minor) + dirhash(name) % NDIRBUCKET;
+  for(;; fbn += NDIRBUCKET){
+    x = ibmap(&din, fbn, 1);
+    rsect(x, buf);
+    for(d = (struct dirent*)buf; d < (struct dirent*)(buf + BSIZE); d++){
+      if(d->inum == 0){
+        *d = de;
+        wsect(x, buf);
+        if((fbn + 1) * BSIZE > xint(din.size))
+          din.size = xint((fbn + 1) * BSIZE);
+        winode(dinum, &din);
+        return;
+      }
+    }
+  }
+}
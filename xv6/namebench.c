@@ -0,0 +1,69 @@
+// Path lookup benchmark.
+// Repeatedly opens existing paths and looks up missing ones,
+// then prints lookups per second and the name lookup cache's
+// hits and misses over the run.
+//
+// usage: namebench [rounds]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+char *paths[] = {
+  "/README",
+  "/sh",
+  "./cat",
+  "/nbdir/a/b/c",
+  "/nosuch",        // missing: a negative cache entry
+  "/nbdir/a/nosuch",
+};
+#define NPATHS (sizeof(paths)/sizeof(paths[0]))
+
+int
+main(int argc, char *argv[])
+{
+  int rounds, r, i, fd, t0, ticks, n;
+  uint h0, m0, h1, m1;
+
+  rounds = 1000;
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+
+  mkdir("nbdir");
+  mkdir("nbdir/a");
+  mkdir("nbdir/a/b");
+  fd = open("nbdir/a/b/c", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf(2, "namebench: create failed\n");
+    exit();
+  }
+  close(fd);
+
+  namestat(&h0, &m0);
+  t0 = uptime();
+  n = 0;
+  for(r = 0; r < rounds; r++){
+    for(i = 0; i < NPATHS; i++){
+      fd = open(paths[i], O_RDONLY);
+      if(fd >= 0)
+        close(fd);
+      n++;
+    }
+  }
+  ticks = uptime() - t0;
+  namestat(&h1, &m1);
+  if(ticks == 0)
+    ticks = 1;
+
+  printf(1, "namebench: %d lookups in %d ticks, %d lookups/s\n",
+         n, ticks, n * 100 / ticks);
+  printf(1, "namebench: name cache %d hits, %d misses\n",
+         h1 - h0, m1 - m0);
+
+  unlink("nbdir/a/b/c");
+  unlink("nbdir/a/b");
+  unlink("nbdir/a");
+  unlink("nbdir");
+  exit();
+}
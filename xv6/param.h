@@ -3,12 +3,22 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // initial size of inode cache
+#define NINODEMAX   500  // maximum size of inode cache
+#define NDENTRY     256  // size of name lookup cache
+#define PIPESIZE   4096  // default size of a pipe's buffer
+#define PIPEMIN     512  // smallest pipe buffer, a power of two
+#define PIPEMAX   65536  // largest pipe buffer, a power of two
 #define NDEV         10  // maximum major device number
+#define NLOCKCLASS   32  // lock names kept statistics for
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define MAXPATH     128  // longest path a system call takes
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define LOGSIZE      120  // max data blocks in one transaction (the
+                          // commit header must fit in one block)
+#define LOGBLOCKS    (LOGSIZE*4)  // size of on-disk log, in blocks
+#define NBUF         (LOGSIZE*3+MAXOPBLOCKS*3)  // size of disk block cache
+                                       // (room for pinned, not yet installed blocks)
+#define FSSIZE       20000  // size of file system in blocks
 #define MAX_SYSCALLS 128
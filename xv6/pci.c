@@ -0,0 +1,81 @@
+// Minimal PCI bus support: configuration space access through
+// the legacy 0xCF8/0xCFC ports, and a brute-force scan of
+// bus 0-255 to find a device by id or class.
+// Used by drivers that need a device's I/O ports (ide.c's
+// bus-master DMA registers) rather than fixed ISA addresses.
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+#include "pci.h"
+
+static uint
+confaddr(struct pcidev *d, uint off)
+{
+  return 0x80000000 | (d->bus << 16) | (d->dev << 11) |
+         (d->func << 8) | (off & 0xFC);
+}
+
+uint
+pciconfread(struct pcidev *d, uint off)
+{
+  outl(PCI_CONF_ADDR, confaddr(d, off));
+  return inl(PCI_CONF_DATA);
+}
+
+void
+pciconfwrite(struct pcidev *d, uint off, uint v)
+{
+  outl(PCI_CONF_ADDR, confaddr(d, off));
+  outl(PCI_CONF_DATA, v);
+}
+
+// Find the first function matching vendor, device and class
+// (class<<8 | subclass); PCI_ANY matches anything.
+// Fills in *d and returns 0, or returns -1 if there is none.
+int
+pcifind(int vendor, int device, int class, struct pcidev *d)
+{
+  uint id, cl;
+  int i;
+
+  for(d->bus = 0; d->bus < 256; d->bus++){
+    for(d->dev = 0; d->dev < 32; d->dev++){
+      for(d->func = 0; d->func < 8; d->func++){
+        id = pciconfread(d, PCI_ID);
+        if((id & 0xFFFF) == 0xFFFF){
+          if(d->func == 0)
+            break;  // no device in this slot
+          continue;
+        }
+        cl = pciconfread(d, PCI_CLASS);
+        if(vendor != PCI_ANY && (id & 0xFFFF) != vendor)
+          continue;
+        if(device != PCI_ANY && (id >> 16) != device)
+          continue;
+        if(class != PCI_ANY && (cl >> 16) != class)
+          continue;
+        d->vendor = id & 0xFFFF;
+        d->device = id >> 16;
+        d->class = cl >> 24;
+        d->subclass = cl >> 16;
+        d->irq = pciconfread(d, PCI_INTR) & 0xFF;
+        for(i = 0; i < 6; i++)
+          d->bar[i] = pciconfread(d, PCI_BAR0 + 4*i);
+        return 0;
+      }
+    }
+  }
+  return -1;
+}
+
+// Turn on I/O decoding and bus mastering for d.
+void
+pcienable(struct pcidev *d)
+{
+  uint cmd;
+
+  cmd = pciconfread(d, PCI_CMD);
+  cmd |= PCI_CMD_IO | PCI_CMD_MEM | PCI_CMD_MASTER;
+  pciconfwrite(d, PCI_CMD, cmd & 0xFFFF);
+}
@@ -0,0 +1,30 @@
+// PCI configuration space.
+
+#define PCI_CONF_ADDR   0xCF8
+#define PCI_CONF_DATA   0xCFC
+
+// Configuration space register offsets.
+#define PCI_ID          0x00    // device id << 16 | vendor id
+#define PCI_CMD         0x04    // status << 16 | command
+#define PCI_CLASS       0x08    // class, subclass, prog-if, revision
+#define PCI_BAR0        0x10    // base address registers 0-5
+#define PCI_INTR        0x3C    // interrupt line (low byte)
+
+// Command register bits.
+#define PCI_CMD_IO      0x0001  // respond to I/O space accesses
+#define PCI_CMD_MEM     0x0002  // respond to memory space accesses
+#define PCI_CMD_MASTER  0x0004  // allow the device to master the bus (DMA)
+
+#define PCI_ANY         -1      // wildcard for pcifind()
+
+struct pcidev {
+  uint bus;
+  uint dev;
+  uint func;
+  ushort vendor;
+  ushort device;
+  uchar class;
+  uchar subclass;
+  uchar irq;
+  uint bar[6];
+};
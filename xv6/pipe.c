@@ -7,18 +7,74 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
 
-#define PIPESIZE 512
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
+// A pipe is a ring of p->size bytes, held in one or more pages:
+// a power of two from PIPEMIN to PIPEMAX, PIPESIZE unless set
+// with fcntl(F_SETPIPE_SZ). Readers hold rlock and
+// writers wlock for the whole of a call, so while a reader
+// holds rlock, the bytes in the ring are its own, and while a
+// writer holds wlock, the free space is. pipepeek() and
+// pipereserve() use that to lend the ring to the file layer,
+// so splice() can move data between a pipe and a file, or
+// another pipe, without copying it through user memory.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  struct sleeplock rlock;  // one reader at a time
+  struct sleeplock wlock;  // one writer at a time
+  int peeking;             // a reader has bytes lent by pipepeek()
+  uint size;               // bytes in the ring
+  char *data[PIPEMAX/PGSIZE];  // its pages
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+// Pointer to the byte that count n (p->nread or p->nwrite)
+// refers to, and the number of bytes from there to the end
+// of its page or of the ring.
+static char*
+pipeptr(struct pipe *p, uint n)
+{
+  n %= p->size;
+  return p->data[n / PGSIZE] + n % PGSIZE;
+}
+
+static uint
+piperun(struct pipe *p, uint n)
+{
+  n %= p->size;
+  return min(p->size - n, PGSIZE - n % PGSIZE);
+}
+
+// Allocate pages for a ring of size bytes into data[].
+static int
+pipepages(char **data, uint size)
+{
+  int i;
+
+  for(i = 0; i * PGSIZE < size; i++){
+    if((data[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(data[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void
+pipefreepages(char **data, uint size)
+{
+  int i;
+
+  for(i = 0; i * PGSIZE < size; i++)
+    kfree(data[i]);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,11 +86,20 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  p->size = PIPESIZE;
+  if(pipepages(p->data, p->size) < 0){
+    kfree((char*)p);
+    p = 0;
+    goto bad;
+  }
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
   p->nread = 0;
+  p->peeking = 0;
   initlock(&p->lock, "pipe");
+  initsleeplock(&p->rlock, "piperead");
+  initsleeplock(&p->wlock, "pipewrite");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
@@ -69,53 +134,218 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
+    pipefreepages(p->data, p->size);
     kfree((char*)p);
   } else
     release(&p->lock);
 }
 
+// Return the size of the pipe's buffer.
+int
+pipegetsize(struct pipe *p)
+{
+  return p->size;
+}
+
+// Change the size of the pipe's buffer to at least size bytes,
+// keeping the bytes in it. Returns the new size, or -1 if the
+// bytes do not fit or a splice() is reading the pipe.
+int
+pipesetsize(struct pipe *p, int size)
+{
+  char *data[PIPEMAX/PGSIZE];
+  uint n, m, nsize;
+
+  if(size < 0 || size > PIPEMAX)
+    return -1;
+  for(nsize = PIPEMIN; nsize < size; nsize *= 2)
+    ;
+  if(pipepages(data, nsize) < 0)
+    return -1;
+
+  acquiresleep(&p->wlock);
+  acquire(&p->lock);
+  if(p->peeking || p->nwrite - p->nread > nsize){
+    release(&p->lock);
+    releasesleep(&p->wlock);
+    pipefreepages(data, nsize);
+    return -1;
+  }
+  // Copy the bytes to the start of the new ring.
+  for(n = 0; p->nread != p->nwrite; n += m){
+    m = min(piperun(p, p->nread), p->nwrite - p->nread);
+    memmove(data[n / PGSIZE] + n % PGSIZE, pipeptr(p, p->nread), m);
+    p->nread += m;
+  }
+  pipefreepages(p->data, p->size);
+  memmove(p->data, data, sizeof(data));
+  p->size = nsize;
+  p->nread = 0;
+  p->nwrite = n;
+  wakeup(&p->nwrite);
+  release(&p->lock);
+  releasesleep(&p->wlock);
+  return nsize;
+}
+
 //PAGEBREAK: 40
+// Wait for free space in the ring. Returns the number of
+// contiguous free bytes at p->nwrite, or -1 if there will
+// never be any. Caller holds p->wlock and p->lock.
+static int
+pipespace(struct pipe *p)
+{
+  while(p->nwrite == p->nread + p->size){  //DOC: pipewrite-full
+    if(p->readopen == 0 || myproc()->killed)
+      return -1;
+    wakeup(&p->nread);
+    sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+  }
+  return min(p->size - (p->nwrite - p->nread), piperun(p, p->nwrite));
+}
+
+// Wait for bytes in the ring. Returns the number of contiguous
+// bytes at p->nread, 0 at end of file, or -1 if killed.
+// Caller holds p->rlock and p->lock.
+static int
+pipedata(struct pipe *p)
+{
+  while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
+    if(myproc()->killed)
+      return -1;
+    sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+  }
+  return min(p->nwrite - p->nread, piperun(p, p->nread));
+}
+
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
-  int i;
+  int i, m;
 
+  acquiresleep(&p->wlock);
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
-      if(p->readopen == 0 || myproc()->killed){
-        release(&p->lock);
-        return -1;
-      }
-      wakeup(&p->nread);
-      sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+  for(i = 0; i < n; i += m){
+    if((m = pipespace(p)) < 0){
+      release(&p->lock);
+      releasesleep(&p->wlock);
+      return -1;
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    m = min(m, n - i);
+    memmove(pipeptr(p, p->nwrite), addr + i, m);
+    p->nwrite += m;
   }
   wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   release(&p->lock);
+  releasesleep(&p->wlock);
   return n;
 }
 
 int
 piperead(struct pipe *p, char *addr, int n)
 {
-  int i;
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return pipereadv(p, &iov, 1);
+}
+
+// Read into the cnt segments of iov. Like read(), this waits
+// only until the pipe has some bytes, then fills the segments
+// with what is there.
+int
+pipereadv(struct pipe *p, struct iovec *iov, int cnt)
+{
+  int i, j, m, tot;
+  char *addr;
 
+  acquiresleep(&p->rlock);
   acquire(&p->lock);
-  while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
-    if(myproc()->killed){
-      release(&p->lock);
-      return -1;
-    }
-    sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+  if((m = pipedata(p)) < 0){
+    release(&p->lock);
+    releasesleep(&p->rlock);
+    return -1;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  // The bytes may wrap around the end of a page or the ring.
+  tot = 0;
+  for(j = 0; j < cnt && m > 0; j++){
+    addr = iov[j].iov_base;
+    for(i = 0; i < iov[j].iov_len && m > 0; i += m){  //DOC: piperead-copy
+      m = min(m, iov[j].iov_len - i);
+      memmove(addr + i, pipeptr(p, p->nread), m);
+      p->nread += m;
+      m = min(p->nwrite - p->nread, piperun(p, p->nread));
+    }
+    tot += i;
   }
   wakeup(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
-  return i;
+  releasesleep(&p->rlock);
+  return tot;
+}
+
+// Lend the bytes at the front of the pipe to the caller:
+// set *addr to them and return how many there are (at most
+// n), or 0 at end of file, or -1 if killed. Unless it
+// returns 0 or less, the caller must then call pipeconsume()
+// with the number it used.
+int
+pipepeek(struct pipe *p, char **addr, int n)
+{
+  int m;
+
+  if(n <= 0)
+    return 0;
+  acquiresleep(&p->rlock);
+  acquire(&p->lock);
+  m = pipedata(p);
+  *addr = pipeptr(p, p->nread);
+  p->peeking = m > 0;
+  release(&p->lock);
+  if(m <= 0)
+    releasesleep(&p->rlock);
+  return min(m, n);
+}
+
+// Remove n of the bytes lent by pipepeek() from the pipe.
+void
+pipeconsume(struct pipe *p, int n)
+{
+  acquire(&p->lock);
+  p->nread += n;
+  p->peeking = 0;
+  wakeup(&p->nwrite);
+  release(&p->lock);
+  releasesleep(&p->rlock);
+}
+
+// Lend free space at the end of the pipe to the caller:
+// set *addr to it and return how many bytes there are (at
+// most n), or -1 if the pipe cannot be written. The caller
+// must then call pipecommit() with the number it filled in.
+int
+pipereserve(struct pipe *p, char **addr, int n)
+{
+  int m;
+
+  acquiresleep(&p->wlock);
+  acquire(&p->lock);
+  m = pipespace(p);
+  *addr = pipeptr(p, p->nwrite);
+  release(&p->lock);
+  if(m < 0)
+    releasesleep(&p->wlock);
+  return min(m, n);
+}
+
+// Add n bytes written into the space lent by pipereserve().
+void
+pipecommit(struct pipe *p, int n)
+{
+  acquire(&p->lock);
+  p->nwrite += n;
+  wakeup(&p->nread);
+  release(&p->lock);
+  releasesleep(&p->wlock);
 }
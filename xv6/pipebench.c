@@ -0,0 +1,169 @@
+// Pipe throughput benchmark. Prints MB/s for:
+//   write/read   one process writes a pipe, another reads it,
+//                for several pipe buffer sizes, with the number
+//                of context switches per MB
+//   splice       a file spliced into a pipe, the pipe into a file
+//   cat|grep|wc  the shell pipeline over a file, as sh runs it
+//
+// usage: pipebench [MB]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+
+#define CHUNK 4096
+#define FILEMB 1
+
+char buf[CHUNK];
+
+// Ticks are 10ms; print MB/s with one decimal without floating point.
+static void
+report(char *what, int kb, int ticks)
+{
+  int r;
+
+  if(ticks == 0)
+    ticks = 1;
+  r = kb * 100 * 10 / 1024 / ticks;
+  printf(1, "pipebench: %s %d KB in %d ticks, %d.%d MB/s\n",
+         what, kb, ticks, r / 10, r % 10);
+}
+
+static void
+writeread(int kb, int size)
+{
+  int p[2], i, n, t0, sw;
+
+  if(pipe(p) < 0){
+    printf(2, "pipebench: pipe failed\n");
+    exit();
+  }
+  if((size = fcntl(p[1], F_SETPIPE_SZ, size)) < 0){
+    printf(2, "pipebench: F_SETPIPE_SZ failed\n");
+    exit();
+  }
+  sw = cswitches();
+  t0 = uptime();
+  if(fork() == 0){
+    close(p[0]);
+    for(i = 0; i < kb * 1024 / CHUNK; i++)
+      write(p[1], buf, CHUNK);
+    exit();
+  }
+  close(p[1]);
+  while((n = read(p[0], buf, CHUNK)) > 0)
+    ;
+  close(p[0]);
+  wait();
+  t0 = uptime() - t0;
+  sw = cswitches() - sw;
+
+  printf(1, "pipebench: pipe buffer %d bytes\n", size);
+  report("write/read", kb, t0);
+  printf(1, "pipebench: %d context switches, %d per MB\n",
+         sw, sw * 1024 / kb);
+}
+
+static void
+splicefile(int kb)
+{
+  int p[2], fd, n, t0;
+
+  if(pipe(p) < 0){
+    printf(2, "pipebench: pipe failed\n");
+    exit();
+  }
+  t0 = uptime();
+  if(fork() == 0){
+    close(p[0]);
+    fd = open("pbin", O_RDONLY);
+    while(splice(fd, p[1], CHUNK) > 0)
+      ;
+    exit();
+  }
+  close(p[1]);
+  fd = open("pbout", O_CREATE | O_RDWR);
+  while((n = splice(p[0], fd, CHUNK)) > 0)
+    ;
+  close(fd);
+  close(p[0]);
+  wait();
+  if(n < 0)
+    printf(2, "pipebench: splice failed\n");
+  report("splice", kb, uptime() - t0);
+  unlink("pbout");
+}
+
+// Run argv[0] with fd in as stdin and fd out as stdout.
+static void
+run(char **argv, int in, int out)
+{
+  if(fork() == 0){
+    if(in != 0){
+      close(0);
+      dup(in);
+    }
+    if(out != 1){
+      close(1);
+      dup(out);
+    }
+    exec(argv[0], argv);
+    printf(2, "pipebench: exec %s failed\n", argv[0]);
+    exit();
+  }
+}
+
+static void
+pipeline(int kb)
+{
+  static char *cat[] = { "cat", "pbin", 0 };
+  static char *grep[] = { "grep", "x", 0 };
+  static char *wc[] = { "wc", 0 };
+  int p1[2], p2[2], t0, out;
+
+  out = open("pbwc", O_CREATE | O_RDWR);
+  t0 = uptime();
+  pipe(p1);
+  run(cat, 0, p1[1]);
+  close(p1[1]);
+  pipe(p2);
+  run(grep, p1[0], p2[1]);
+  close(p1[0]);
+  close(p2[1]);
+  run(wc, p2[0], out);
+  close(p2[0]);
+  wait();
+  wait();
+  wait();
+  report("cat|grep|wc", kb, uptime() - t0);
+  close(out);
+  unlink("pbwc");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb, kb, i, fd;
+
+  mb = FILEMB;
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  kb = mb * 1024;
+
+  // Lines of text, so grep and wc have work to do.
+  for(i = 0; i < CHUNK; i++)
+    buf[i] = (i % 64 == 63) ? '\n' : 'a' + i % 26;
+  fd = open("pbin", O_CREATE | O_RDWR);
+  for(i = 0; i < kb * 1024 / CHUNK; i++)
+    write(fd, buf, CHUNK);
+  close(fd);
+
+  for(i = PIPEMIN; i <= PIPEMAX; i *= 8)
+    writeread(kb, i);
+  splicefile(kb);
+  pipeline(kb);
+  unlink("pbin");
+  exit();
+}
@@ -3,17 +3,11 @@
 #include "user.h"
 
 static void
-putc(int fd, char c)
-{
-  write(fd, &c, 1);
-}
-
-static void
-printint(int fd, int xx, int base, int sgn)
+printint(FILE *f, int xx, int base, int sgn)
 {
   static char digits[] = "0123456789ABCDEF";
-  char buf[16];
-  int i, neg;
+  char buf[16], out[16];
+  int i, j, neg;
   uint x;
 
   neg = 0;
@@ -31,55 +25,98 @@ printint(int fd, int xx, int base, int sgn)
   if(neg)
     buf[i++] = '-';
 
-  while(--i >= 0)
-    putc(fd, buf[i]);
+  for(j = 0; --i >= 0; j++)
+    out[j] = buf[i];
+  fwrite(out, 1, j, f);
 }
 
-// Print to the given fd. Only understands %d, %x, %p, %s.
-void
-printf(int fd, const char *fmt, ...)
+// Format into stream f. Runs of the format between
+// conversions are passed on whole.
+static void
+vprintf(FILE *f, const char *fmt, uint *ap)
 {
   char *s;
-  int c, i, state;
-  uint *ap;
+  int c, i, j, state;
 
   state = 0;
-  ap = (uint*)(void*)&fmt + 1;
   for(i = 0; fmt[i]; i++){
     c = fmt[i] & 0xff;
     if(state == 0){
       if(c == '%'){
         state = '%';
       } else {
-        putc(fd, c);
+        for(j = i; fmt[j+1] && fmt[j+1] != '%'; j++)
+          ;
+        fwrite(fmt + i, 1, j + 1 - i, f);
+        i = j;
       }
     } else if(state == '%'){
       if(c == 'd'){
-        printint(fd, *ap, 10, 1);
+        printint(f, *ap, 10, 1);
         ap++;
       } else if(c == 'x' || c == 'p'){
-        printint(fd, *ap, 16, 0);
+        printint(f, *ap, 16, 0);
         ap++;
       } else if(c == 's'){
         s = (char*)*ap;
         ap++;
         if(s == 0)
           s = "(null)";
-        while(*s != 0){
-          putc(fd, *s);
-          s++;
-        }
+        fputs(s, f);
       } else if(c == 'c'){
-        putc(fd, *ap);
+        fputc(*ap, f);
         ap++;
       } else if(c == '%'){
-        putc(fd, c);
+        fputc(c, f);
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c);
+        fputc('%', f);
+        fputc(c, f);
       }
       state = 0;
     }
   }
 }
+
+// Format into f, or, if f is unbuffered, into a buffer on
+// the stack that is written with one write() at the end.
+static void
+vfprintf(FILE *f, int fd, const char *fmt, uint *ap)
+{
+  FILE tmp;
+  char buf[128];
+
+  if(f && f->mode != _IONBF){
+    vprintf(f, fmt, ap);
+    return;
+  }
+  memset(&tmp, 0, sizeof(tmp));
+  tmp.fd = f ? f->fd : fd;
+  tmp.flags = _FWRITE;
+  tmp.mode = _IOFBF;
+  tmp.buf = buf;
+  tmp.size = sizeof(buf);
+  vprintf(&tmp, fmt, ap);
+  fflush(&tmp);
+}
+
+void
+fprintf(FILE *f, const char *fmt, ...)
+{
+  vfprintf(f, -1, fmt, (uint*)(void*)&fmt + 1);
+}
+
+// Print to the given fd. Only understands %d, %x, %p, %s.
+// Output to 1 and 2 goes through stdout and stderr.
+void
+printf(int fd, const char *fmt, ...)
+{
+  FILE *f;
+
+  f = 0;
+  if(fd == 1)
+    f = stdout;
+  else if(fd == 2)
+    f = stderr;
+  vfprintf(f, fd, fmt, (uint*)(void*)&fmt + 1);
+}
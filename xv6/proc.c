@@ -11,8 +11,19 @@
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  uint nswtch;    // context switches to processes since boot
 } ptable;
 
+// Futex wait queues, hashed by the kernel address of the
+// futex word, which is the same in every mapping of it.
+#define NFUTEX 64
+#define FUTEXHASH(k) (((uint)(k) >> 2) % NFUTEX)
+
+struct {
+  struct spinlock lock;
+  struct proc *head;
+} futexq[NFUTEX];
+
 static struct proc *initproc;
 
 int nextpid = 1;
@@ -24,7 +35,11 @@ static void wakeup1(void *chan);
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(i = 0; i < NFUTEX; i++)
+    initlock(&futexq[i].lock, "futex");
 }
 
 // Must be called with interrupts disabled
@@ -89,6 +104,12 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->pgdir = 0;
+  p->ofile = 0;
+  p->ustack = 0;
+  p->syscall_count = 0;
+  p->nsyscall = 0;
+  p->cnsyscall = 0;
 
   release(&ptable.lock);
 
@@ -124,6 +145,54 @@ found:
   return p;
 }
 
+// Create a new process running the program at path, as fork()
+// followed by exec() would, but without copying the caller's
+// memory. The child takes over the open files in ofile.
+int
+spawn(char *path, char **argv, struct file **ofile)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  memset(np->tf, 0, sizeof(*np->tf));
+  np->tf->cs = (SEG_UCODE << 3) | DPL_USER;
+  np->tf->ds = (SEG_UDATA << 3) | DPL_USER;
+  np->tf->es = np->tf->ds;
+  np->tf->ss = np->tf->ds;
+  np->tf->eflags = FL_IF;
+  if((np->ofile = fdtalloc()) == 0 ||
+     (np->pgdir = loadimage(path, argv, &np->sz, np->tf)) == 0){
+    if(np->ofile)
+      fdtput(np->ofile);
+    np->ofile = 0;
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  np->parent = curproc;
+
+  for(i = 0; i < NOFILE; i++)
+    np->ofile[i] = ofile[i];
+  np->cwd = idup(curproc->cwd);
+
+  safestrcpy(np->name, progname(path), sizeof(np->name));
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  np->state = RUNNABLE;
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
 //PAGEBREAK: 32
 // Set up first user process.
 void
@@ -135,7 +204,7 @@ userinit(void)
   p = allocproc();
   
   initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
+  if((p->pgdir = setupkvm()) == 0 || (p->ofile = fdtalloc()) == 0)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
   p->sz = PGSIZE;
@@ -163,26 +232,73 @@ userinit(void)
 }
 
 // Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Return the old size on success, -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
+  uint sz, oldsz;
+  struct proc *p;
   struct proc *curproc = myproc();
 
-  sz = curproc->sz;
+  // Threads share the page table and its size, so grow it
+  // under ptable.lock and tell all of them. Shrinking would
+  // leave freed pages in other CPUs' TLBs, and there is no
+  // shootdown, so only a lone thread may do it.
+  acquire(&ptable.lock);
+  sz = oldsz = curproc->sz;
+  if(n < 0){
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p != curproc && p->pgdir == curproc->pgdir &&
+         p->state != UNUSED && p->state != ZOMBIE){
+        release(&ptable.lock);
+        return -1;
+      }
+    }
+  }
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0){
+      release(&ptable.lock);
       return -1;
+    }
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0){
+      release(&ptable.lock);
       return -1;
+    }
   }
-  curproc->sz = sz;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state != UNUSED && p->pgdir == curproc->pgdir)
+      p->sz = sz;
+  release(&ptable.lock);
   switchuvm(curproc);
+  return oldsz;
+}
+
+// Is pgdir in use by a process other than p?
+// Caller must hold ptable.lock.
+static int
+vmshared1(struct proc *p, pde_t *pgdir)
+{
+  struct proc *q;
+
+  for(q = ptable.proc; q < &ptable.proc[NPROC]; q++)
+    if(q != p && q->state != UNUSED && q->pgdir == pgdir)
+      return 1;
   return 0;
 }
 
+// Does p share its memory with other threads?
+int
+vmshared(struct proc *p)
+{
+  int r;
+
+  acquire(&ptable.lock);
+  r = vmshared1(p, p->pgdir);
+  release(&ptable.lock);
+  return r;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
@@ -199,7 +315,11 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  if((np->ofile = fdtalloc()) == 0 ||
+     (np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+    if(np->ofile)
+      fdtput(np->ofile);
+    np->ofile = 0;
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
@@ -213,8 +333,7 @@ fork(void)
   np->tf->eax = 0;
 
   for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
+    np->ofile[i] = fdget(curproc->ofile, i);
   np->cwd = idup(curproc->cwd);
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
@@ -243,6 +362,72 @@ fork(void)
   return pid;
 }
 
+// Create a thread: a child that shares the caller's memory
+// and descriptor table and runs fn(arg1, arg2) on the page at
+// stack. If fn returns, the thread faults at 0xffffffff; it
+// should call exit() instead.
+int
+clone(void (*fn)(void*, void*), void *arg1, void *arg2, void *stack)
+{
+  int pid;
+  uint sp, ustack[3];
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  if((uint)stack % PGSIZE || (uint)stack + PGSIZE > curproc->sz ||
+     (uint)stack + PGSIZE < (uint)stack)
+    return -1;
+  // Threads must not race to copy a copy-on-write page, so
+  // copy them all before the new thread can run.
+  if(uvmcowall(curproc->pgdir, curproc->sz) < 0)
+    return -1;
+  sp = (uint)stack + PGSIZE - sizeof(ustack);
+  if(!uvmwritable(curproc->pgdir, sp, sizeof(ustack)))
+    return -1;
+  if((np = allocproc()) == 0)
+    return -1;
+
+  ustack[0] = 0xffffffff;  // fake return PC
+  ustack[1] = (uint)arg1;
+  ustack[2] = (uint)arg2;
+  if(copyout(curproc->pgdir, sp, ustack, sizeof(ustack)) < 0){
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+
+  np->pgdir = curproc->pgdir;
+  np->sz = curproc->sz;
+  np->parent = curproc;
+  np->ustack = stack;
+  *np->tf = *curproc->tf;
+  np->tf->eip = (uint)fn;
+  np->tf->esp = sp;
+  np->tf->eax = 0;
+
+  np->ofile = curproc->ofile;
+  fdtdup(np->ofile);
+  np->cwd = idup(curproc->cwd);
+
+  // Attached regions are already in the shared page table;
+  // whichever thread exits last detaches them.
+  for(int i = 0; i < SHAREDREGIONS; i++)
+    np->pages[i] = curproc->pages[i];
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  np->state = RUNNABLE;
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
 
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
@@ -251,23 +436,29 @@ void exit(void)
 {
   struct proc *curproc = myproc();
   struct proc *p;
-  int fd;
+  struct file **ofile;
+  int last;
 
   if (curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for (fd = 0; fd < NOFILE; fd++)
-  {
-    if (curproc->ofile[fd])
-    {
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
-  }
+  // A thread that has not started exiting still has its
+  // ofile; clearing ours in the same critical section makes
+  // exactly one of several exiting threads the last.
+  acquire(&ptable.lock);
+  last = 1;
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if (p != curproc && p->pgdir == curproc->pgdir && p->ofile)
+      last = 0;
+  ofile = curproc->ofile;
+  curproc->ofile = 0;
+  release(&ptable.lock);
+
+  // Close all open files, if no other thread shares them.
+  fdtput(ofile);
 
     // detach, attached shared regions
-  for(int i = 0; i < SHAREDREGIONS; i++) {
+  for(int i = 0; i < SHAREDREGIONS && last; i++) {
     if(curproc->pages[i].shmid != -1 && curproc->pages[i].key != -1) {
       // wrapper that calls detach
       close_sharedmemWrapper(curproc->pages[i].virtualAddr);
@@ -301,6 +492,24 @@ void exit(void)
   panic("zombie exit");
 }
 
+// Free a zombie, and its memory if no thread still uses it.
+// Caller must hold ptable.lock.
+static void
+reap(struct proc *p)
+{
+  kfree(p->kstack);
+  p->kstack = 0;
+  if(!vmshared1(p, p->pgdir))
+    freevm(p->pgdir);
+  p->pgdir = 0;
+  p->ofile = 0;
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  p->state = UNUSED;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
 int
@@ -315,20 +524,14 @@ wait(void)
     // Scan through table looking for exited children.
     havekids = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
+      if(p->parent != curproc || p->pgdir == curproc->pgdir)
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
+        curproc->cnsyscall += p->nsyscall + p->cnsyscall;
+        reap(p);
         release(&ptable.lock);
         return pid;
       }
@@ -345,6 +548,42 @@ wait(void)
   }
 }
 
+// Wait for a child thread to exit and return its pid. The
+// stack it was given in clone() is stored in *stack. Return -1
+// if this process has no child threads.
+int
+join(void **stack)
+{
+  struct proc *p;
+  int havekids, pid;
+  struct proc *curproc = myproc();
+
+  acquire(&ptable.lock);
+  for(;;){
+    havekids = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p->parent != curproc || p->pgdir != curproc->pgdir)
+        continue;
+      havekids = 1;
+      if(p->state == ZOMBIE){
+        pid = p->pid;
+        *stack = p->ustack;
+        curproc->cnsyscall += p->nsyscall + p->cnsyscall;
+        reap(p);
+        release(&ptable.lock);
+        return pid;
+      }
+    }
+
+    if(!havekids || curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+
+    sleep(curproc, &ptable.lock);  //DOC: wait-sleep
+  }
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -376,6 +615,7 @@ scheduler(void)
       c->proc = p;
       switchuvm(p);
       p->state = RUNNING;
+      ptable.nswtch++;
 
       swtch(&(c->scheduler), p->context);
       switchkvm();
@@ -389,6 +629,18 @@ scheduler(void)
   }
 }
 
+// Number of context switches to processes since boot.
+int
+cswitches(void)
+{
+  int n;
+
+  acquire(&ptable.lock);
+  n = ptable.nswtch;
+  release(&ptable.lock);
+  return n;
+}
+
 // Enter scheduler.  Must hold only ptable.lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -530,6 +782,89 @@ kill(int pid)
   return -1;
 }
 
+//PAGEBREAK!
+// Futexes.
+
+// Kernel address of the futex word at user address addr, or
+// 0 if it is not an aligned, writable word. A copy-on-write
+// page is copied first, so that writes after the wait
+// don't move the word to another page.
+static char*
+futexkey(uint addr)
+{
+  pde_t *pgdir;
+
+  pgdir = myproc()->pgdir;
+  if(addr % 4 || !uvmwritable(pgdir, addr, 4))
+    return 0;
+  return uva2ka(pgdir, (char*)PGROUNDDOWN(addr)) + addr % PGSIZE;
+}
+
+// Sleep until futex_wake() on addr, if the word there holds
+// val. Returns 0 when woken; -1 if the word had changed, the
+// address is bad, or the process was killed.
+int
+futex_wait(uint addr, uint val)
+{
+  struct proc *curproc = myproc();
+  struct proc **pp;
+  char *key;
+  int q;
+
+  if((key = futexkey(addr)) == 0)
+    return -1;
+  q = FUTEXHASH(key);
+  acquire(&futexq[q].lock);
+  if(*(volatile uint*)key != val){
+    release(&futexq[q].lock);
+    return -1;
+  }
+  curproc->futex = key;
+  curproc->fnext = futexq[q].head;
+  futexq[q].head = curproc;
+  while(curproc->futex && !curproc->killed)
+    sleep(&curproc->futex, &futexq[q].lock);
+  if(curproc->futex){
+    // Killed while waiting.
+    for(pp = &futexq[q].head; *pp != curproc; pp = &(*pp)->fnext)
+      ;
+    *pp = curproc->fnext;
+    curproc->futex = 0;
+    release(&futexq[q].lock);
+    return -1;
+  }
+  release(&futexq[q].lock);
+  return 0;
+}
+
+// Wake up to n processes waiting on the futex word at addr.
+// Returns how many were woken, or -1 if the address is bad.
+int
+futex_wake(uint addr, int n)
+{
+  struct proc *p, **pp;
+  char *key;
+  int q, woken;
+
+  if((key = futexkey(addr)) == 0)
+    return -1;
+  q = FUTEXHASH(key);
+  woken = 0;
+  acquire(&futexq[q].lock);
+  for(pp = &futexq[q].head; *pp && woken < n; ){
+    p = *pp;
+    if(p->futex == key){
+      *pp = p->fnext;
+      p->futex = 0;
+      wakeup(&p->futex);
+      woken++;
+    } else
+      pp = &p->fnext;
+  }
+  release(&futexq[q].lock);
+  return woken;
+}
+
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
@@ -64,11 +64,16 @@ struct proc {
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
+  struct file **ofile;         // Open files, shared by threads
+  void *ustack;                // Thread's user stack, for join()
+  char *futex;                 // If non-zero, futex word waited on
+  struct proc *fnext;          // Next waiter in futex queue
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
   struct syscall_entry syscalls[MAX_SYSCALLS];
   int syscall_count;
+  int nsyscall;                // System calls made
+  int cnsyscall;               // System calls made by reaped children
   sharedPages pages[SHAREDREGIONS];
 };
 
@@ -3,6 +3,7 @@
 #include "types.h"
 #include "user.h"
 #include "fcntl.h"
+#include "spawn.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,6 +53,10 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+int simple(char*);
+int spawncmd(struct cmd*, struct spawnact*, int);
+void freecmd(struct cmd*);
+void runpipe(struct cmd*, int, int*);
 
 // Execute cmd.  Never returns.
 void
@@ -101,20 +106,8 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
-    if(fork1() == 0){
-      close(1);
-      dup(p[1]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->left);
-    }
-    if(fork1() == 0){
-      close(0);
-      dup(p[0]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->right);
-    }
+    runpipe(pcmd->left, 1, p);
+    runpipe(pcmd->right, 0, p);
     close(p[0]);
     close(p[1]);
     wait();
@@ -130,6 +123,30 @@ runcmd(struct cmd *cmd)
   exit();
 }
 
+// Start one side of a pipeline, with fd (0 or 1) on pipe p.
+void
+runpipe(struct cmd *cmd, int fd, int *p)
+{
+  struct spawnact act[SPAWN_MAX];
+
+  act[0].op = SPAWN_DUP2;
+  act[0].fd = fd;
+  act[0].arg = p[fd];
+  act[1].op = SPAWN_CLOSE;
+  act[1].fd = p[0];
+  act[2].op = SPAWN_CLOSE;
+  act[2].fd = p[1];
+  if(spawncmd(cmd, act, 3) != 0)
+    return;
+  if(fork1() == 0){
+    close(fd);
+    dup(p[fd]);
+    close(p[0]);
+    close(p[1]);
+    runcmd(cmd);
+  }
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -145,7 +162,9 @@ int
 main(void)
 {
   static char buf[100];
-  int fd;
+  struct spawnact act[SPAWN_MAX];
+  struct cmd *cmd;
+  int fd, pid;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -164,9 +183,18 @@ main(void)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait();
+    // Spawn simple commands rather than fork a copy of the shell.
+    cmd = 0;
+    pid = 0;
+    if(simple(buf)){
+      cmd = parsecmd(buf);
+      pid = spawncmd(cmd, act, 0);
+    }
+    if(pid == 0 && (pid = fork1()) == 0)
+      runcmd(cmd ? cmd : parsecmd(buf));
+    if(pid > 0)
+      wait();
+    freecmd(cmd);
   }
   exit();
 }
@@ -491,3 +519,92 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+//PAGEBREAK!
+// Spawning
+
+// Whether the line s is one command with redirections, which
+// the shell can parse itself: the parser panics on bad input,
+// so anything it might reject is left to a forked child.
+int
+simple(char *s)
+{
+  int nword;
+
+  nword = 0;
+  while(*s){
+    if(strchr("|&;()", *s))
+      return 0;
+    if(*s == '<' || *s == '>'){
+      if(*s++ == '>' && *s == '>')
+        s++;
+      while(*s && strchr(whitespace, *s))
+        s++;
+      if(*s == 0 || strchr(symbols, *s))
+        return 0;
+    } else if(strchr(whitespace, *s))
+      s++;
+    else {
+      if(++nword >= MAXARGS)
+        return 0;
+      while(*s && !strchr(whitespace, *s) && !strchr(symbols, *s))
+        s++;
+    }
+  }
+  return 1;
+}
+
+// Spawn cmd if it is an exec with redirections, after the
+// nact actions at act, which has room for SPAWN_MAX. Returns
+// the child's pid, -1 if spawn failed, or 0 if cmd must be
+// run by a forked shell instead.
+int
+spawncmd(struct cmd *cmd, struct spawnact *act, int nact)
+{
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  int pid;
+
+  for(; cmd->type == REDIR; cmd = rcmd->cmd){
+    rcmd = (struct redircmd*)cmd;
+    if(nact == SPAWN_MAX)
+      return 0;
+    act[nact].op = SPAWN_OPEN;
+    act[nact].fd = rcmd->fd;
+    act[nact].arg = rcmd->mode;
+    act[nact].path = rcmd->file;
+    nact++;
+  }
+  if(cmd->type != EXEC)
+    return 0;
+  ecmd = (struct execcmd*)cmd;
+  if(ecmd->argv[0] == 0)
+    return 0;
+  if((pid = spawn(ecmd->argv[0], ecmd->argv, act, nact)) < 0)
+    printf(2, "exec %s failed\n", ecmd->argv[0]);
+  return pid;
+}
+
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+  case PIPE:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+  case LIST:
+    freecmd(((struct listcmd*)cmd)->left);
+    freecmd(((struct listcmd*)cmd)->right);
+    break;
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
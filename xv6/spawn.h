@@ -0,0 +1,14 @@
+// File actions for spawn(), applied in order to the child's
+// copy of the caller's open files.
+struct spawnact {
+  int op;      // SPAWN_*
+  int fd;      // descriptor acted on
+  int arg;     // SPAWN_DUP2: descriptor copied; SPAWN_OPEN: mode
+  char *path;  // SPAWN_OPEN: file opened
+};
+
+#define SPAWN_CLOSE 1  // close fd
+#define SPAWN_DUP2  2  // make fd a copy of arg
+#define SPAWN_OPEN  3  // open path as fd
+
+#define SPAWN_MAX 8    // most actions in one spawn()
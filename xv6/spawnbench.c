@@ -0,0 +1,120 @@
+// Process launch benchmark. Prints launches per second for:
+//   fork+exec   fork(), exec() in the child, wait()
+//   spawn       spawn() and wait()
+//   sh          sh reading a script of commands, one per line,
+//               which it spawns
+// Each launch runs this program with argument "-", which exits
+// at once. The caller's memory is grown first by KB kilobytes,
+// which fork copies and spawn does not.
+//
+// usage: spawnbench [n [KB]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "spawn.h"
+
+char *quitargv[] = { "spawnbench", "-", 0 };
+char *shargv[] = { "sh", 0 };
+
+// Ticks are 10ms.
+static void
+report(char *what, int n, int ticks)
+{
+  if(ticks == 0)
+    ticks = 1;
+  printf(1, "spawnbench: %s %d in %d ticks, %d/s\n",
+         what, n, ticks, n * 100 / ticks);
+}
+
+static void
+forkexec(int n)
+{
+  int i, pid, t0;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if((pid = fork()) < 0){
+      printf(2, "spawnbench: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(quitargv[0], quitargv);
+      printf(2, "spawnbench: exec failed\n");
+      exit();
+    }
+    wait();
+  }
+  report("fork+exec", n, uptime() - t0);
+}
+
+static void
+spawnwait(int n)
+{
+  int i, t0;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    if(spawn(quitargv[0], quitargv, 0, 0) < 0){
+      printf(2, "spawnbench: spawn failed\n");
+      exit();
+    }
+    wait();
+  }
+  report("spawn", n, uptime() - t0);
+}
+
+static void
+shloop(int n)
+{
+  struct spawnact act[2];
+  int i, fd, t0;
+
+  if((fd = open("spawnbench.sh", O_CREATE|O_WRONLY)) < 0){
+    printf(2, "spawnbench: cannot create spawnbench.sh\n");
+    exit();
+  }
+  for(i = 0; i < n; i++)
+    write(fd, "spawnbench -\n", 13);
+  close(fd);
+
+  // The script on sh's input, its prompts out of the way.
+  act[0].op = SPAWN_OPEN;
+  act[0].fd = 0;
+  act[0].arg = O_RDONLY;
+  act[0].path = "spawnbench.sh";
+  act[1].op = SPAWN_OPEN;
+  act[1].fd = 2;
+  act[1].arg = O_CREATE|O_WRONLY;
+  act[1].path = "spawnbench.err";
+  t0 = uptime();
+  if(spawn(shargv[0], shargv, act, 2) < 0){
+    printf(2, "spawnbench: spawn sh failed\n");
+    exit();
+  }
+  wait();
+  report("sh commands", n, uptime() - t0);
+  unlink("spawnbench.sh");
+  unlink("spawnbench.err");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, kb;
+
+  if(argc > 1 && strcmp(argv[1], "-") == 0)
+    exit();
+  n = argc > 1 ? atoi(argv[1]) : 200;
+  kb = argc > 2 ? atoi(argv[2]) : 0;
+  if(n <= 0 || kb < 0 || (kb && sbrk(kb * 1024) == (char*)-1)){
+    printf(2, "usage: spawnbench [n [KB]]\n");
+    exit();
+  }
+  printf(1, "spawnbench: %d launches, %d KB extra memory\n", n, kb);
+  forkexec(n);
+  spawnwait(n);
+  shloop(n);
+  exit();
+}
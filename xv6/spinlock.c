@@ -8,13 +8,63 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+// Statistics are kept per class of locks with the same name,
+// so that locks in memory that is later freed (pipes) can be
+// counted. Each CPU has its own counters in a class, which it
+// updates with interrupts off, so they need no lock.
+
+struct lockclass {
+  char *name;
+  struct {
+    uint nacquire;
+    uint ncontend;
+    uint spinlo, spinhi;  // cycles spent spinning
+    uint maxhold;
+  } cpu[NCPU];
+};
+
+static struct lockclass classes[NLOCKCLASS];
+static int nclass;
+static uint classlock;   // guards adding to classes
+
+// The class for locks named name, added if new.
+// Returns 0 if the table is full. The first locks are made
+// before mycpu() works, so this can't use pushcli().
+static struct lockclass*
+lockclass(char *name)
+{
+  struct lockclass *c;
+  uint eflags;
+
+  eflags = readeflags();
+  cli();
+  while(xchg(&classlock, 1) != 0)
+    ;
+  for(c = classes; c < classes + nclass; c++)
+    if(strncmp(c->name, name, 16) == 0)
+      goto out;
+  if(nclass < NLOCKCLASS){
+    c->name = name;
+    nclass++;
+  } else
+    c = 0;
+out:
+  xchg(&classlock, 0);
+  if(eflags & FL_IF)
+    sti();
+  return c;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->class = lockclass(name);
 }
 
 // Acquire the lock.
@@ -24,13 +74,26 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  struct lockclass *c;
+  uint ticket, t0, spin;
+  int i;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // The xadd is atomic. Waiters then only read owner, on
+  // another cache line, which stays in their caches until
+  // the holder writes it: at release, and when it records
+  // itself below.
+  ticket = xadd(&lk->next, 1);
+  spin = 0;
+  if(*(volatile uint*)&lk->owner != ticket){
+    t0 = rdtsc();
+    while(*(volatile uint*)&lk->owner != ticket)
+      pause();
+    spin = rdtsc() - t0;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,15 +103,37 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+
+  if((c = lk->class) != 0){
+    i = lk->cpu - cpus;
+    c->cpu[i].nacquire++;
+    if(spin){
+      c->cpu[i].ncontend++;
+      c->cpu[i].spinlo += spin;
+      if(c->cpu[i].spinlo < spin)
+        c->cpu[i].spinhi++;
+    }
+  }
+  lk->tacquire = rdtsc();
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  uint hold;
+  int i;
+
   if(!holding(lk))
     panic("release");
 
+  if(lk->class){
+    hold = rdtsc() - lk->tacquire;
+    i = lk->cpu - cpus;
+    if(hold > lk->class->cpu[i].maxhold)
+      lk->class->cpu[i].maxhold = hold;
+  }
+
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
@@ -59,14 +144,54 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Release the lock by serving the next ticket. Only the
+  // holder writes owner, so this needs no lock prefix, but
+  // it must be one instruction.
+  asm volatile("incl %0" : "+m" (lk->owner) : );
 
   popcli();
 }
 
+// Copy the statistics of lock class i into *ls, summed over
+// CPUs. Returns -1 if there is no class i.
+int
+lockstatget(int i, struct lockstat *ls)
+{
+  struct lockclass *c;
+  uint lo, hi;
+  int j;
+
+  if(i < 0 || i >= nclass)
+    return -1;
+  c = &classes[i];
+  memset(ls, 0, sizeof(*ls));
+  safestrcpy(ls->name, c->name, sizeof(ls->name));
+  lo = hi = 0;
+  for(j = 0; j < NCPU; j++){
+    ls->nacquire += c->cpu[j].nacquire;
+    ls->ncontend += c->cpu[j].ncontend;
+    lo += c->cpu[j].spinlo;
+    if(lo < c->cpu[j].spinlo)
+      hi++;
+    hi += c->cpu[j].spinhi;
+    if(c->cpu[j].maxhold > ls->maxhold)
+      ls->maxhold = c->cpu[j].maxhold;
+  }
+  ls->spink = (hi << 22) | (lo >> 10);
+  return 0;
+}
+
+// Zero the statistics of every lock class. Counts bumped
+// while this runs may survive.
+void
+lockstatreset(void)
+{
+  int i;
+
+  for(i = 0; i < nclass; i++)
+    memset(classes[i].cpu, 0, sizeof(classes[i].cpu));
+}
+
 // Record the current call stack in pcs[] by following the %ebp chain.
 void
 getcallerpcs(void *v, uint pcs[])
@@ -91,7 +216,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->owner != lock->next && lock->cpu == mycpu();
   popcli();
   return r;
 }
@@ -1,11 +1,22 @@
-// Mutual exclusion lock.
+// Mutual exclusion lock: a ticket lock. Each acquirer takes
+// the next ticket and spins until owner reaches it, so CPUs
+// get the lock in the order they asked for it. next and owner
+// are a cache line apart, so a newcomer taking a ticket does
+// not steal the line the spinners are reading.
+#define CACHELINE 64
+
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out
+  char pad[CACHELINE - sizeof(uint)];
+  uint owner;        // Ticket holding the lock; free if equal to next
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
-};
 
+  // For lockstat:
+  struct lockclass *class;  // Statistics shared by locks of this name
+  uint tacquire;     // rdtsc() when acquired
+};
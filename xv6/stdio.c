@@ -0,0 +1,350 @@
+// Buffered I/O streams.
+//
+// A stream collects small reads and writes into one buffer, so
+// that reading a line or printing a few words costs one read()
+// or write() per buffer rather than one per byte. A stream is
+// either fully buffered (written when the buffer fills),
+// line buffered (also written at each newline) or unbuffered.
+// stdout is line buffered when it is the console and fully
+// buffered otherwise; stderr is unbuffered.
+//
+// Buffered output is written by fflush(), fclose(), and by the
+// exit() and fork() wrappers in ulib.c.
+
+#include "types.h"
+#include "stat.h"
+#include "fcntl.h"
+#include "user.h"
+
+#define NSTREAM 16
+
+static char stdinbuf[BUFSIZ], stdoutbuf[BUFSIZ];
+
+static FILE streams[NSTREAM] = {
+  { 0, _FREAD, _IOFBF, stdinbuf, BUFSIZ },
+  { 1, _FWRITE, -1, stdoutbuf, BUFSIZ },
+  { 2, _FWRITE, _IONBF, 0, 0 },
+};
+
+FILE *stdin = &streams[0];
+FILE *stdout = &streams[1];
+FILE *stderr = &streams[2];
+
+extern void (*stdioflush)(void);
+
+static void
+flushall(void)
+{
+  FILE *f;
+
+  for(f = streams; f < streams + NSTREAM; f++)
+    if(f->flags & _FWRITE)
+      fflush(f);
+}
+
+// Decide a stream's buffering on first use: line buffered
+// for the console, fully buffered for files and pipes.
+static void
+setmode(FILE *f)
+{
+  struct stat st;
+
+  if(f->mode >= 0)
+    return;
+  if(fstat(f->fd, &st) == 0 && st.type == T_DEV)
+    f->mode = _IOLBF;
+  else
+    f->mode = _IOFBF;
+}
+
+FILE*
+fdopen(int fd, const char *mode)
+{
+  FILE *f;
+
+  if(fd < 0)
+    return 0;
+  for(f = streams; f < streams + NSTREAM; f++)
+    if(f->flags == 0)
+      break;
+  if(f == streams + NSTREAM)
+    return 0;
+  if((f->buf = malloc(BUFSIZ)) == 0)
+    return 0;
+  f->fd = fd;
+  f->flags = (mode[0] == 'r' ? _FREAD : _FWRITE) | _FMYBUF;
+  f->mode = _IOFBF;
+  f->size = BUFSIZ;
+  f->pos = 0;
+  f->len = 0;
+  return f;
+}
+
+// Open path for reading ("r") or writing ("w"), creating it
+// if need be. There is no truncation, as with open().
+FILE*
+fopen(const char *path, const char *mode)
+{
+  FILE *f;
+  int fd;
+
+  if(mode[0] == 'r')
+    fd = open(path, O_RDONLY);
+  else
+    fd = open(path, O_CREATE|O_WRONLY);
+  if(fd < 0)
+    return 0;
+  if((f = fdopen(fd, mode)) == 0)
+    close(fd);
+  return f;
+}
+
+int
+fclose(FILE *f)
+{
+  int r;
+
+  r = fflush(f);
+  if(close(f->fd) < 0)
+    r = EOF;
+  if(f->flags & _FMYBUF)
+    free(f->buf);
+  f->flags = 0;
+  return r;
+}
+
+// Write out f's buffered output; all streams' if f is 0.
+int
+fflush(FILE *f)
+{
+  int n, off;
+
+  if(f == 0){
+    flushall();
+    return 0;
+  }
+  if(!(f->flags & _FWRITE))
+    return 0;
+  for(off = 0; off < f->pos; off += n){
+    if((n = write(f->fd, f->buf + off, f->pos - off)) <= 0){
+      f->flags |= _FERR;
+      f->pos = 0;
+      return EOF;
+    }
+  }
+  f->pos = 0;
+  return 0;
+}
+
+// Give f the buffer buf of size bytes (or one stdio allocates,
+// if buf is 0) and buffering mode. Call before any I/O on f.
+int
+setvbuf(FILE *f, char *buf, int mode, int size)
+{
+  if(mode < _IOFBF || mode > _IONBF)
+    return EOF;
+  fflush(f);
+  if(f->flags & _FMYBUF)
+    free(f->buf);
+  f->flags &= ~_FMYBUF;
+  f->buf = 0;
+  f->size = 0;
+  if(mode != _IONBF){
+    if(size <= 0)
+      size = BUFSIZ;
+    if(buf == 0){
+      if((buf = malloc(size)) == 0)
+        return EOF;
+      f->flags |= _FMYBUF;
+    }
+    f->buf = buf;
+    f->size = size;
+  }
+  f->mode = mode;
+  f->pos = 0;
+  f->len = 0;
+  return 0;
+}
+
+// Read the next buffer's worth of f.
+static int
+refill(FILE *f)
+{
+  int n;
+
+  if(f->flags & (_FEOF|_FERR))
+    return EOF;
+  // Whatever a prompt asked should be visible before waiting.
+  if(stdout->mode == _IOLBF)
+    fflush(stdout);
+  if(f->buf == 0)
+    n = read(f->fd, &f->ch, 1);
+  else
+    n = read(f->fd, f->buf, f->size);
+  if(n <= 0){
+    f->flags |= n == 0 ? _FEOF : _FERR;
+    return EOF;
+  }
+  f->pos = 0;
+  f->len = n;
+  return 0;
+}
+
+int
+fgetc(FILE *f)
+{
+  if(f->pos >= f->len && refill(f) < 0)
+    return EOF;
+  return (uchar)(f->buf ? f->buf : &f->ch)[f->pos++];
+}
+
+// Read a line, with its newline, or up to n-1 bytes into s.
+// Returns 0 at end of file if nothing was read.
+char*
+fgets(char *s, int n, FILE *f)
+{
+  int i, c;
+
+  for(i = 0; i+1 < n; ){
+    if((c = fgetc(f)) == EOF)
+      break;
+    s[i++] = c;
+    if(c == '\n')
+      break;
+  }
+  s[i] = '\0';
+  return i > 0 ? s : 0;
+}
+
+// Read a line from stdin, which also ends at '\r'.
+char*
+gets(char *buf, int max)
+{
+  int i, c;
+
+  for(i=0; i+1 < max; ){
+    if((c = fgetc(stdin)) == EOF)
+      break;
+    buf[i++] = c;
+    if(c == '\n' || c == '\r')
+      break;
+  }
+  buf[i] = '\0';
+  return buf;
+}
+
+// Read nmemb items of size bytes. Requests of a buffer or
+// more, after what is already buffered, go straight to read().
+int
+fread(void *p, int size, int nmemb, FILE *f)
+{
+  char *dst;
+  int n, m, tot;
+
+  dst = p;
+  n = size * nmemb;
+  for(tot = 0; tot < n; tot += m){
+    if(f->pos >= f->len){
+      if(n - tot >= f->size && !(f->flags & (_FEOF|_FERR))){
+        if((m = read(f->fd, dst + tot, n - tot)) <= 0){
+          f->flags |= m == 0 ? _FEOF : _FERR;
+          break;
+        }
+        continue;
+      }
+      if(refill(f) < 0)
+        break;
+    }
+    m = f->len - f->pos;
+    if(m > n - tot)
+      m = n - tot;
+    memmove(dst + tot, (f->buf ? f->buf : &f->ch) + f->pos, m);
+    f->pos += m;
+  }
+  return size > 0 ? tot / size : 0;
+}
+
+int
+fputc(int c, FILE *f)
+{
+  char ch;
+
+  setmode(f);
+  if(f->mode == _IONBF){
+    ch = c;
+    if(write(f->fd, &ch, 1) != 1){
+      f->flags |= _FERR;
+      return EOF;
+    }
+    return (uchar)c;
+  }
+  // A full buffer left by fwrite() or a failed flush.
+  if(f->pos >= f->size && (fflush(f) < 0 || f->pos >= f->size))
+    return EOF;
+  stdioflush = flushall;
+  f->buf[f->pos++] = c;
+  if(f->pos == f->size || (f->mode == _IOLBF && c == '\n'))
+    if(fflush(f) < 0)
+      return EOF;
+  return (uchar)c;
+}
+
+// Write nmemb items of size bytes. What does not fit in the
+// buffer after flushing it goes straight to write().
+int
+fwrite(const void *p, int size, int nmemb, FILE *f)
+{
+  const char *src;
+  int n, i, nl;
+
+  setmode(f);
+  src = p;
+  n = size * nmemb;
+  if(n <= 0)
+    return 0;
+  if(f->mode == _IONBF || n >= f->size){
+    if(f->mode != _IONBF && fflush(f) < 0)
+      return 0;
+    if(write(f->fd, src, n) != n){
+      f->flags |= _FERR;
+      return 0;
+    }
+    return nmemb;
+  }
+  if(f->pos + n > f->size && fflush(f) < 0)
+    return 0;
+  if(f->pos + n > f->size)
+    return 0;
+  stdioflush = flushall;
+  memmove(f->buf + f->pos, src, n);
+  f->pos += n;
+  if(f->mode == _IOLBF){
+    for(nl = 0, i = 0; i < n; i++)
+      if(src[i] == '\n')
+        nl = 1;
+    if(nl && fflush(f) < 0)
+      return 0;
+  }
+  return nmemb;
+}
+
+int
+fputs(const char *s, FILE *f)
+{
+  int n;
+
+  n = strlen(s);
+  return fwrite(s, 1, n, f) == n ? 0 : EOF;
+}
+
+int
+feof(FILE *f)
+{
+  return (f->flags & _FEOF) != 0;
+}
+
+int
+ferror(FILE *f)
+{
+  return (f->flags & _FERR) != 0;
+}
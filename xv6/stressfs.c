@@ -13,15 +13,26 @@
 #include "fs.h"
 #include "fcntl.h"
 
+// Each process writes its file in writes of this size, so that
+// the number of log commits shows how many transactions the log
+// lets one write() take. "stressfs n" sets the per-transaction
+// budget to n blocks first.
+#define WSIZE 8192
+
+char data[WSIZE];
+
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int fd, i, top, c0;
   char path[] = "stressfs0";
-  char data[512];
 
-  printf(1, "stressfs starting\n");
+  if(argc > 1)
+    logbudget(atoi(argv[1]));
+  printf(1, "stressfs starting, log budget %d blocks\n", logbudget(0));
   memset(data, 'a', sizeof(data));
+  c0 = logcommits();
+  top = getpid();
 
   for(i = 0; i < 4; i++)
     if(fork() > 0)
@@ -45,5 +56,8 @@ main(int argc, char *argv[])
 
   wait();
 
+  if(getpid() == top)
+    printf(1, "stressfs: %d KB written in %d log commits\n",
+           5 * 20 * WSIZE / 1024, logcommits() - c0);
   exit();
 }
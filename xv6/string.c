@@ -1,19 +1,64 @@
 #include "types.h"
+#include "defs.h"
 #include "x86.h"
+#include "mmu.h"
+
+// The memory and string primitives come in two versions: one
+// that works a byte at a time and one that moves aligned 4-byte
+// words, with rep movsl/stosl for the bulk of long copies and
+// fills. strfast selects between them (build with -DSTRFAST=0
+// for the byte versions); strinit() checks the word versions
+// against the byte ones at boot and times both.
+
+#ifndef STRFAST
+#define STRFAST 1
+#endif
+
+int strfast = STRFAST;
+
+#define ONES  0x01010101
+#define HIGHS 0x80808080
+#define HASZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+static void*
+memset_b(void *dst, int c, uint n)
+{
+  char *d;
+
+  for(d = dst; n > 0; n--)
+    *d++ = c;
+  return dst;
+}
+
+static void*
+memset_w(void *dst, int c, uint n)
+{
+  char *d;
+
+  d = dst;
+  c &= 0xFF;
+  if(n >= 16){
+    while((uint)d & 3){
+      *d++ = c;
+      n--;
+    }
+    stosl(d, c * ONES, n/4);
+    d += n & ~3;
+    n &= 3;
+  }
+  while(n-- > 0)
+    *d++ = c;
+  return dst;
+}
 
 void*
 memset(void *dst, int c, uint n)
 {
-  if ((int)dst%4 == 0 && n%4 == 0){
-    c &= 0xFF;
-    stosl(dst, (c<<24)|(c<<16)|(c<<8)|c, n/4);
-  } else
-    stosb(dst, c, n);
-  return dst;
+  return strfast ? memset_w(dst, c, n) : memset_b(dst, c, n);
 }
 
-int
-memcmp(const void *v1, const void *v2, uint n)
+static int
+memcmp_b(const void *v1, const void *v2, uint n)
 {
   const uchar *s1, *s2;
 
@@ -28,8 +73,26 @@ memcmp(const void *v1, const void *v2, uint n)
   return 0;
 }
 
-void*
-memmove(void *dst, const void *src, uint n)
+int
+memcmp(const void *v1, const void *v2, uint n)
+{
+  const uchar *s1, *s2;
+
+  s1 = v1;
+  s2 = v2;
+  if(strfast){
+    // Skip equal words; x86 allows unaligned loads.
+    while(n >= 4 && *(uint*)s1 == *(uint*)s2){
+      s1 += 4;
+      s2 += 4;
+      n -= 4;
+    }
+  }
+  return memcmp_b(s1, s2, n);
+}
+
+static void*
+memmove_b(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
@@ -48,6 +111,56 @@ memmove(void *dst, const void *src, uint n)
   return dst;
 }
 
+// Copies forward when dst is below src, backward when it
+// overlaps src from above, aligning dst and moving words.
+static void*
+memmove_w(void *dst, const void *src, uint n)
+{
+  const char *s;
+  char *d;
+
+  s = src;
+  d = dst;
+  if(s < d && s + n > d){
+    s += n;
+    d += n;
+    if(n >= 16){
+      while((uint)d & 3){
+        *--d = *--s;
+        n--;
+      }
+      for(; n >= 4; n -= 4){
+        d -= 4;
+        s -= 4;
+        *(uint*)d = *(uint*)s;
+      }
+    }
+    while(n-- > 0)
+      *--d = *--s;
+  } else {
+    if(n >= 16){
+      while((uint)d & 3){
+        *d++ = *s++;
+        n--;
+      }
+      movsl(d, s, n/4);
+      d += n & ~3;
+      s += n & ~3;
+      n &= 3;
+    }
+    while(n-- > 0)
+      *d++ = *s++;
+  }
+
+  return dst;
+}
+
+void*
+memmove(void *dst, const void *src, uint n)
+{
+  return strfast ? memmove_w(dst, src, n) : memmove_b(dst, src, n);
+}
+
 // memcpy exists to placate GCC.  Use memmove.
 void*
 memcpy(void *dst, const void *src, uint n)
@@ -93,8 +206,8 @@ safestrcpy(char *s, const char *t, int n)
   return os;
 }
 
-int
-strlen(const char *s)
+static int
+strlen_b(const char *s)
 {
   int n;
 
@@ -103,3 +216,109 @@ strlen(const char *s)
   return n;
 }
 
+// Looks at aligned words, which cannot cross into an
+// unmapped page, until one has a zero byte.
+int
+strlen(const char *s)
+{
+  const char *p;
+
+  if(!strfast)
+    return strlen_b(s);
+  for(p = s; (uint)p & 3; p++)
+    if(*p == 0)
+      return p - s;
+  while(!HASZERO(*(uint*)p))
+    p += 4;
+  while(*p)
+    p++;
+  return p - s;
+}
+
+//PAGEBREAK!
+// Boot-time check and timing of the word versions.
+
+static void
+strcheck(char *a, char *b, char *c)
+{
+  int i, so, doff, n;
+
+  for(i = 0; i < 256; i++)
+    a[i] = i*7 + 1;
+  for(so = 0; so < 4; so++)
+    for(doff = 0; doff < 8; doff++)
+      for(n = 0; n < 80; n++){
+        // Copies between buffers, then overlapping both ways.
+        memset_b(b, 0, 256);
+        memset_b(c, 0, 256);
+        memmove_w(b + doff, a + so, n);
+        memmove_b(c + doff, a + so, n);
+        if(memcmp_b(b, c, 256) != 0)
+          panic("strinit: memmove");
+        memmove_b(c, a, 256);
+        memmove_b(b, a, 256);
+        memmove_w(b + 64 + doff, b + 64 + so, n);
+        memmove_b(c + 64 + doff, c + 64 + so, n);
+        if(memcmp_b(b, c, 256) != 0)
+          panic("strinit: overlapping memmove");
+        memmove_w(b + 64 + so, b + 64 + doff, n);
+        memmove_b(c + 64 + so, c + 64 + doff, n);
+        if(memcmp_b(b, c, 256) != 0)
+          panic("strinit: overlapping memmove");
+        memset_w(b + doff, so + 0x80, n);
+        memset_b(c + doff, so + 0x80, n);
+        if(memcmp_b(b, c, 256) != 0)
+          panic("strinit: memset");
+        c[doff + n] = 0;
+        if(strlen(c + doff) != strlen_b(c + doff))
+          panic("strinit: strlen");
+        b[doff + n/2] ^= 1;
+        if((memcmp(b, c, 256) < 0) != (memcmp_b(b, c, 256) < 0) ||
+           (memcmp(b, c, 256) == 0) != (memcmp_b(b, c, 256) == 0))
+          panic("strinit: memcmp");
+      }
+}
+
+// Return bytes per cycle, in hundredths, of f copying or
+// filling a page 256 times.
+static uint
+strtime(void *(*mv)(void*, const void*, uint), void *(*set)(void*, int, uint),
+        char *a, char *b)
+{
+  uint t, i;
+
+  t = rdtsc();
+  for(i = 0; i < 256; i++){
+    if(mv)
+      mv(b, a, PGSIZE);
+    else
+      set(b, i, PGSIZE);
+  }
+  t = rdtsc() - t;
+  if(t == 0)
+    t = 1;
+  return 256*PGSIZE / (t/100 + 1);
+}
+
+void
+strinit(void)
+{
+  char *a, *b, *c;
+  uint w, y;
+
+  if((a = kalloc()) == 0 || (b = kalloc()) == 0 || (c = kalloc()) == 0)
+    panic("strinit");
+  strcheck(a, b, c);
+  w = strtime(memmove_w, 0, a, b);
+  y = strtime(memmove_b, 0, a, b);
+  cprintf("string: memmove %d.%d%d bytes/cycle (bytes %d.%d%d)",
+          w/100, w/10%10, w%10, y/100, y/10%10, y%10);
+  w = strtime(0, memset_w, a, b);
+  y = strtime(0, memset_b, a, b);
+  cprintf(", memset %d.%d%d (bytes %d.%d%d), %s versions\n",
+          w/100, w/10%10, w%10, y/100, y/10%10, y%10,
+          strfast ? "word" : "byte");
+  kfree(a);
+  kfree(b);
+  kfree(c);
+}
@@ -0,0 +1,88 @@
+// Parallel sum benchmark. Sums an array of n ints rounds
+// times, split among 1, 2, 4 and 8 threads, and prints the
+// ticks each takes. Each thread adds its share into a total
+// under a lock.
+//
+// usage: sumbench [n [rounds]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define MAXTHREADS 8
+
+int *a;
+int n, rounds;
+uint total;
+lock_t lock;
+
+static void
+worker(void *arg1, void *arg2)
+{
+  int i, r, lo, hi;
+  uint sum;
+
+  lo = (int)arg1;
+  hi = (int)arg2;
+  sum = 0;
+  for(r = 0; r < rounds; r++)
+    for(i = lo; i < hi; i++)
+      sum += a[i];
+  lock_acquire(&lock);
+  total += sum;
+  lock_release(&lock);
+  exit();
+}
+
+static void
+run(int nthreads, uint want)
+{
+  int i, t0, t;
+
+  total = 0;
+  t0 = uptime();
+  for(i = 0; i < nthreads; i++){
+    if(thread_create(worker, (void*)(n * i / nthreads),
+                     (void*)(n * (i+1) / nthreads)) < 0){
+      printf(2, "sumbench: thread_create failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < nthreads; i++)
+    if(thread_join() < 0){
+      printf(2, "sumbench: thread_join failed\n");
+      exit();
+    }
+  t = uptime() - t0;
+  if(total != want){
+    printf(2, "sumbench: %d threads: sum %d, want %d\n", nthreads, total, want);
+    exit();
+  }
+  printf(1, "sumbench: %d threads %d ticks\n", nthreads, t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+  uint want;
+
+  n = argc > 1 ? atoi(argv[1]) : 256*1024;
+  rounds = argc > 2 ? atoi(argv[2]) : 20;
+  if(n <= 0 || rounds <= 0 || (a = malloc(n * sizeof(int))) == 0){
+    printf(2, "usage: sumbench [n [rounds]]\n");
+    exit();
+  }
+  want = 0;
+  for(i = 0; i < n; i++){
+    a[i] = i;
+    want += i;
+  }
+  want *= rounds;
+  lock_init(&lock);
+
+  printf(1, "sumbench: %d ints, %d rounds\n", n, rounds);
+  for(i = 1; i <= MAXTHREADS; i *= 2)
+    run(i, want);
+  exit();
+}
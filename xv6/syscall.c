@@ -17,32 +17,26 @@
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
-
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
-    return -1;
-  *ip = *(int*)(addr);
-  return 0;
+  return copyin(ip, addr, 4);
 }
 
-// Fetch the nul-terminated string at addr from the current process.
-// Doesn't actually copy the string - just sets *pp to point at it.
-// Returns length of string, not including nul.
+// Copy the nul-terminated string at addr from the current process
+// into buf, which holds max bytes. Returns length of string, not
+// including nul, or -1 if it doesn't fit. A string running into an
+// unmapped page faults in ustrlen() or ucopy(), which return -1.
 int
-fetchstr(uint addr, char **pp)
+fetchstr(uint addr, char *buf, int max)
 {
-  char *s, *ep;
-  struct proc *curproc = myproc();
+  int n;
 
-  if(addr >= curproc->sz)
+  if(addr >= KERNBASE || max <= 0)
     return -1;
-  *pp = (char*)addr;
-  ep = (char*)curproc->sz;
-  for(s = *pp; s < ep; s++){
-    if(*s == 0)
-      return s - *pp;
-  }
-  return -1;
+  if(max > KERNBASE - addr)
+    max = KERNBASE - addr;
+  if((n = ustrlen((char*)addr, max)) < 0 || ucopy(buf, (char*)addr, n) < 0)
+    return -1;
+  buf[n] = 0;  // in case it changed since ustrlen()
+  return n;
 }
 
 // Fetch the nth 32-bit system call argument.
@@ -69,17 +63,27 @@ argptr(int n, char **pp, int size)
   return 0;
 }
 
-// Fetch the nth word-sized system call argument as a string pointer.
-// Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// Like argptr, for a block the kernel will write, which must
+// not be read-only, as shared program text is.
+int
+argwptr(int n, char **pp, int size)
+{
+  if(argptr(n, pp, size) < 0 || !uvmwritable(myproc()->pgdir, (uint)*pp, size))
+    return -1;
+  return 0;
+}
+
+// Fetch the nth word-sized system call argument as a string, copied
+// into buf, which holds max bytes. Threads and shared memory
+// regions mean the user's copy may change, or be unmapped, while
+// the kernel is using it, so the kernel only uses its own copy.
 int
-argstr(int n, char **pp)
+argstr(int n, char *buf, int max)
 {
   int addr;
   if(argint(n, &addr) < 0)
     return -1;
-  return fetchstr(addr, pp);
+  return fetchstr(addr, buf, max);
 }
 
 extern int sys_chdir(void);
@@ -110,6 +114,26 @@ extern int sys_list_all_processes(void);
 extern int sys_find_palindrome(void);
 extern int sys_open_sharedmem(void);
 extern int sys_close_sharedmem(void);
+extern int sys_diskwrites(void);
+extern int sys_namestat(void);
+extern int sys_splice(void);
+extern int sys_fcntl(void);
+extern int sys_cswitches(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_logbudget(void);
+extern int sys_logcommits(void);
+extern int sys_copy_file_range(void);
+extern int sys_childsyscalls(void);
+extern int sys_spawn(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_lockstat(void);
+extern int sys_logpending(void);
 
 
 static int (*syscalls[])(void) = {
@@ -140,7 +164,27 @@ static int (*syscalls[])(void) = {
 [SYS_list_all_processes] sys_list_all_processes,
 [SYS_find_palindrome] sys_find_palindrome,
 [SYS_open_sharedmem]  sys_open_sharedmem,
-[SYS_close_sharedmem]  sys_close_sharedmem
+[SYS_close_sharedmem]  sys_close_sharedmem,
+[SYS_diskwrites]  sys_diskwrites,
+[SYS_namestat]  sys_namestat,
+[SYS_splice]  sys_splice,
+[SYS_fcntl]  sys_fcntl,
+[SYS_cswitches]  sys_cswitches,
+[SYS_readv]  sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]  sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_logbudget]  sys_logbudget,
+[SYS_logcommits]  sys_logcommits,
+[SYS_copy_file_range]  sys_copy_file_range,
+[SYS_childsyscalls]  sys_childsyscalls,
+[SYS_spawn]  sys_spawn,
+[SYS_clone]  sys_clone,
+[SYS_join]   sys_join,
+[SYS_futex_wait]  sys_futex_wait,
+[SYS_futex_wake]  sys_futex_wake,
+[SYS_lockstat]  sys_lockstat,
+[SYS_logpending]  sys_logpending,
 
 };
 
@@ -152,6 +196,7 @@ syscall(void)
 
   num = curproc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    curproc->nsyscall++;
     curproc->tf->eax = syscalls[num]();
   } else {
     cprintf("%d %s: unknown sys call %d\n",
@@ -26,4 +26,24 @@
 #define SYS_get_most_invoked_syscall 25
 #define SYS_list_all_processes 26
 #define SYS_open_sharedmem 32
-#define SYS_close_sharedmem  33
\ No newline at end of file
+#define SYS_close_sharedmem  33
+#define SYS_diskwrites 34
+#define SYS_namestat 35
+#define SYS_splice 36
+#define SYS_fcntl 37
+#define SYS_cswitches 38
+#define SYS_readv 39
+#define SYS_writev 40
+#define SYS_pread 41
+#define SYS_pwrite 42
+#define SYS_logbudget 43
+#define SYS_logcommits 44
+#define SYS_copy_file_range 45
+#define SYS_childsyscalls 46
+#define SYS_spawn  47
+#define SYS_clone  48
+#define SYS_join   49
+#define SYS_futex_wait 50
+#define SYS_futex_wake 51
+#define SYS_lockstat 52
+#define SYS_logpending 53
@@ -0,0 +1,35 @@
+// Run a command and print how many system calls it made,
+// for example to compare buffered and unbuffered output:
+//   syscount ls
+//   syscount cat README
+//
+// usage: syscount command [args...]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int n0, pid;
+
+  if(argc < 2){
+    printf(2, "usage: syscount command [args...]\n");
+    exit();
+  }
+  n0 = childsyscalls();
+  pid = fork();
+  if(pid < 0){
+    printf(2, "syscount: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    printf(2, "syscount: exec %s failed\n", argv[1]);
+    exit();
+  }
+  wait();
+  printf(2, "syscount: %s made %d system calls\n", argv[1], childsyscalls() - n0);
+  exit();
+}
@@ -10,36 +10,39 @@
 #include "stat.h"
 #include "mmu.h"
 #include "proc.h"
+#include "x86.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "spawn.h"
 #include "syscall.h"
 
 int move_file(char *src_file, char *dest_dir);
 
 // Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// and return a reference to the corresponding struct file, which
+// the caller drops with fileclose(). Another thread sharing the
+// descriptor table may close fd while the file is in use.
 static int
-argfd(int n, int *pfd, struct file **pf)
+argfd(int n, struct file **pf)
 {
   int fd;
   struct file *f;
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE || (f=fdget(myproc()->ofile, fd)) == 0)
     return -1;
-  if(pfd)
-    *pfd = fd;
-  if(pf)
-    *pf = f;
+  *pf = f;
   return 0;
 }
 
 // Allocate a file descriptor for the given file.
 // Takes over file reference from caller on success.
+// Threads share the table, so claim the slot atomically.
 static int
 fdalloc(struct file *f)
 {
@@ -47,10 +50,9 @@ fdalloc(struct file *f)
   struct proc *curproc = myproc();
 
   for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
+    if(curproc->ofile[fd] == 0 &&
+       cmpxchg((uint*)&curproc->ofile[fd], 0, (uint)f) == 0)
       return fd;
-    }
   }
   return -1;
 }
@@ -62,11 +64,10 @@ sys_dup(void)
   int fd;
   record_syscall(SYS_dup);
 
-  if(argfd(0, 0, &f) < 0)
+  if(argfd(0, &f) < 0)
     return -1;
   if((fd=fdalloc(f)) < 0)
-    return -1;
-  filedup(f);
+    fileclose(f);
   return fd;
 }
 
@@ -78,9 +79,11 @@ sys_read(void)
   char *p;
   record_syscall(SYS_read);
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argint(2, &n) < 0 || argwptr(1, &p, n) < 0 || argfd(0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  n = fileread(f, p, n);
+  fileclose(f);
+  return n;
 }
 
 int
@@ -91,9 +94,102 @@ sys_write(void)
   char *p;
   record_syscall(SYS_write);
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argint(2, &n) < 0 || argptr(1, &p, n) < 0 || argfd(0, &f) < 0)
+    return -1;
+  n = filewrite(f, p, n);
+  fileclose(f);
+  return n;
+}
+
+// Fetch the nth system call argument as an array of cnt
+// iovecs, copied into iov, and check that the segments lie
+// within the process address space, and are writable if
+// the kernel is to write them.
+static int
+argiov(int n, struct iovec *iov, int cnt, int writing)
+{
+  struct iovec *uiov;
+  uint sz;
+  int i;
+
+  if(cnt < 0 || cnt > IOV_MAX)
+    return -1;
+  if(argptr(n, (void*)&uiov, cnt*sizeof(*uiov)) < 0)
+    return -1;
+  memmove(iov, uiov, cnt*sizeof(*uiov));
+  sz = myproc()->sz;
+  for(i = 0; i < cnt; i++){
+    if(iov[i].iov_len < 0 || (uint)iov[i].iov_base > sz ||
+       (uint)iov[i].iov_base + iov[i].iov_len > sz)
+      return -1;
+    if(writing && !uvmwritable(myproc()->pgdir, (uint)iov[i].iov_base, iov[i].iov_len))
+      return -1;
+  }
+  return 0;
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+  record_syscall(SYS_readv);
+
+  if(argint(2, &cnt) < 0 || argiov(1, iov, cnt, 1) < 0 || argfd(0, &f) < 0)
     return -1;
-  return filewrite(f, p, n);
+  cnt = filereadv(f, iov, cnt, -1);
+  fileclose(f);
+  return cnt;
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt;
+  record_syscall(SYS_writev);
+
+  if(argint(2, &cnt) < 0 || argiov(1, iov, cnt, 0) < 0 || argfd(0, &f) < 0)
+    return -1;
+  cnt = filewritev(f, iov, cnt, -1);
+  fileclose(f);
+  return cnt;
+}
+
+int
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int off;
+  record_syscall(SYS_pread);
+
+  if(argint(2, &iov.iov_len) < 0 ||
+     argwptr(1, (void*)&iov.iov_base, iov.iov_len) < 0 ||
+     argint(3, &off) < 0 || off < 0 || argfd(0, &f) < 0)
+    return -1;
+  off = filereadv(f, &iov, 1, off);
+  fileclose(f);
+  return off;
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int off;
+  record_syscall(SYS_pwrite);
+
+  if(argint(2, &iov.iov_len) < 0 ||
+     argptr(1, (void*)&iov.iov_base, iov.iov_len) < 0 ||
+     argint(3, &off) < 0 || off < 0 || argfd(0, &f) < 0)
+    return -1;
+  off = filewritev(f, &iov, 1, off);
+  fileclose(f);
+  return off;
 }
 
 int
@@ -103,9 +199,9 @@ sys_close(void)
   struct file *f;
   record_syscall(SYS_close);
 
-  if(argfd(0, &fd, &f) < 0)
+  if(argint(0, &fd) < 0 || fd < 0 || fd >= NOFILE ||
+     (f=fdclear(myproc()->ofile, fd)) == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
@@ -115,22 +211,25 @@ sys_fstat(void)
 {
   struct file *f;
   struct stat *st;
+  int r;
   record_syscall(SYS_fstat);
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argwptr(1, (void*)&st, sizeof(*st)) < 0 || argfd(0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
 {
-  char name[DIRSIZ], *new, *old;
+  char name[DIRSIZ], new[MAXPATH], old[MAXPATH];
   struct inode *dp, *ip;
   record_syscall(SYS_link);
 
-  if(argstr(0, &old) < 0 || argstr(1, &new) < 0)
+  if(argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0)
     return -1;
 
   begin_op();
@@ -195,11 +294,11 @@ sys_unlink(void)
 {
   struct inode *ip, *dp;
   struct dirent de;
-  char name[DIRSIZ], *path;
+  char name[DIRSIZ], path[MAXPATH];
   uint off;
   record_syscall(SYS_unlink);
 
-  if(argstr(0, &path) < 0)
+  if(argstr(0, path, MAXPATH) < 0)
     return -1;
 
   begin_op();
@@ -228,6 +327,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcacheinval(dp, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -292,17 +392,12 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-int
-sys_open(void)
+// Open path with mode omode, for open() and spawn().
+static struct file*
+fileopen(char *path, int omode)
 {
-  char *path;
-  int fd, omode;
   struct file *f;
   struct inode *ip;
-  record_syscall(SYS_open);
-
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
-    return -1;
 
   begin_op();
 
@@ -310,27 +405,25 @@ sys_open(void)
     ip = create(path, T_FILE, 0, 0);
     if(ip == 0){
       end_op();
-      return -1;
+      return 0;
     }
   } else {
     if((ip = namei(path)) == 0){
       end_op();
-      return -1;
+      return 0;
     }
     ilock(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
       end_op();
-      return -1;
+      return 0;
     }
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
   iunlock(ip);
   end_op();
@@ -340,18 +433,37 @@ sys_open(void)
   f->off = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  return f;
+}
+
+int
+sys_open(void)
+{
+  char path[MAXPATH];
+  int fd, omode;
+  struct file *f;
+  record_syscall(SYS_open);
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  if((f = fileopen(path, omode)) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
 int
 sys_mkdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
   record_syscall(SYS_mkdir);
 
   begin_op();
-  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+  if(argstr(0, path, MAXPATH) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
     end_op();
     return -1;
   }
@@ -364,12 +476,12 @@ int
 sys_mknod(void)
 {
   struct inode *ip;
-  char *path;
+  char path[MAXPATH];
   int major, minor;
   record_syscall(SYS_mknod);
 
   begin_op();
-  if((argstr(0, &path)) < 0 ||
+  if((argstr(0, path, MAXPATH)) < 0 ||
      argint(1, &major) < 0 ||
      argint(2, &minor) < 0 ||
      (ip = create(path, T_DEV, major, minor)) == 0){
@@ -384,13 +496,13 @@ sys_mknod(void)
 int
 sys_chdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
   struct proc *curproc = myproc();
   record_syscall(SYS_chdir);
   
   begin_op();
-  if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
+  if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
     end_op();
     return -1;
   }
@@ -407,31 +519,117 @@ sys_chdir(void)
   return 0;
 }
 
+// Fetch the argument vector at user address uargv, copying
+// the strings into a page from kalloc(), which is returned
+// and which the caller frees. They must fit the new stack's
+// page anyway.
+static char*
+fetchargv(uint uargv, char **argv)
+{
+  int i, n;
+  uint uarg;
+  char *page, *s;
+
+  if((page = kalloc()) == 0)
+    return 0;
+  s = page;
+  for(i=0;; i++){
+    if(i >= MAXARG)
+      goto bad;
+    if(fetchint(uargv+4*i, (int*)&uarg) < 0)
+      goto bad;
+    if(uarg == 0){
+      argv[i] = 0;
+      break;
+    }
+    if((n = fetchstr(uarg, s, page + PGSIZE - s)) < 0)
+      goto bad;
+    argv[i] = s;
+    s += n + 1;
+  }
+  return page;
+
+bad:
+  kfree(page);
+  return 0;
+}
+
 int
 sys_exec(void)
 {
-  char *path, *argv[MAXARG];
-  int i;
-  uint uargv, uarg;
+  char path[MAXPATH], *argv[MAXARG], *page;
+  uint uargv;
+  int r;
   record_syscall(SYS_exec);
 
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, (int*)&uargv) < 0 ||
+     (page = fetchargv(uargv, argv)) == 0){
     return -1;
   }
-  memset(argv, 0, sizeof(argv));
-  for(i=0;; i++){
-    if(i >= NELEM(argv))
-      return -1;
-    if(fetchint(uargv+4*i, (int*)&uarg) < 0)
-      return -1;
-    if(uarg == 0){
-      argv[i] = 0;
+  r = exec(path, argv);
+  kfree(page);
+  return r;
+}
+
+// Start path in a new process, like fork() and exec() but
+// without copying the caller's memory. The child's open
+// files are the caller's, changed by the nact actions at act.
+int
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG], file[MAXPATH], *page;
+  struct file *ofile[NOFILE], *f;
+  struct spawnact act[SPAWN_MAX], *a;
+  struct proc *curproc = myproc();
+  int i, nact, pid;
+  uint uargv, uact;
+  record_syscall(SYS_spawn);
+
+  // The actions are copied in before they are checked: another
+  // thread, or a process sharing the memory, could change them.
+  if(argstr(0, path, MAXPATH) < 0 || argint(3, &nact) < 0 ||
+     nact < 0 || nact > SPAWN_MAX || argint(2, (int*)&uact) < 0 ||
+     copyin(act, uact, nact*sizeof(*act)) < 0 ||
+     argint(1, (int*)&uargv) < 0 || (page = fetchargv(uargv, argv)) == 0)
+    return -1;
+
+  for(i = 0; i < NOFILE; i++)
+    ofile[i] = fdget(curproc->ofile, i);
+  for(a = act; a < act+nact; a++){
+    if(a->fd < 0 || a->fd >= NOFILE)
+      goto bad;
+    switch(a->op){
+    case SPAWN_CLOSE:
+      f = 0;
+      break;
+    case SPAWN_DUP2:
+      if(a->arg < 0 || a->arg >= NOFILE || ofile[a->arg] == 0)
+        goto bad;
+      f = filedup(ofile[a->arg]);
       break;
+    case SPAWN_OPEN:
+      if(fetchstr((uint)a->path, file, MAXPATH) < 0 || (f = fileopen(file, a->arg)) == 0)
+        goto bad;
+      break;
+    default:
+      goto bad;
     }
-    if(fetchstr(uarg, &argv[i]) < 0)
-      return -1;
+    if(ofile[a->fd])
+      fileclose(ofile[a->fd]);
+    ofile[a->fd] = f;
   }
-  return exec(path, argv);
+
+  if((pid = spawn(path, argv, ofile)) < 0)
+    goto bad;
+  kfree(page);
+  return pid;
+
+bad:
+  for(i = 0; i < NOFILE; i++)
+    if(ofile[i])
+      fileclose(ofile[i]);
+  kfree(page);
+  return -1;
 }
 
 int
@@ -442,7 +640,7 @@ sys_pipe(void)
   int fd0, fd1;
   record_syscall(SYS_pipe);
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argwptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
@@ -459,68 +657,141 @@ sys_pipe(void)
   return 0;
 }
 
+// Move up to n bytes from fd to fd, one of them a pipe,
+// inside the kernel.
+int
+sys_splice(void)
+{
+  struct file *f, *g;
+  int n;
+
+  record_syscall(SYS_splice);
+  if(argint(2, &n) < 0 || argfd(0, &f) < 0)
+    return -1;
+  if(argfd(1, &g) < 0){
+    fileclose(f);
+    return -1;
+  }
+  n = filesplice(f, g, n);
+  fileclose(f);
+  fileclose(g);
+  return n;
+}
+
+// Copy up to n bytes from file fd to file fd inside the kernel.
+int
+sys_copy_file_range(void)
+{
+  struct file *f, *g;
+  int n;
+
+  record_syscall(SYS_copy_file_range);
+  if(argint(2, &n) < 0 || argfd(0, &f) < 0)
+    return -1;
+  if(argfd(1, &g) < 0){
+    fileclose(f);
+    return -1;
+  }
+  n = filecopy(f, g, n);
+  fileclose(f);
+  fileclose(g);
+  return n;
+}
+
+// File control: get or set the size of a pipe's buffer.
+int
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg, r;
+
+  record_syscall(SYS_fcntl);
+  if(argint(1, &cmd) < 0 || argint(2, &arg) < 0 || argfd(0, &f) < 0)
+    return -1;
+  r = -1;
+  if(f->type == FD_PIPE){
+    switch(cmd){
+    case F_GETPIPE_SZ:
+      r = pipegetsize(f->pipe);
+      break;
+    case F_SETPIPE_SZ:
+      r = pipesetsize(f->pipe, arg);
+      break;
+    }
+  }
+  fileclose(f);
+  return r;
+}
+
+// Hits and misses of the name lookup cache since boot.
+int
+sys_namestat(void)
+{
+  uint *hits, *misses;
+
+  record_syscall(SYS_namestat);
+  if(argwptr(0, (void*)&hits, sizeof(*hits)) < 0 ||
+     argwptr(1, (void*)&misses, sizeof(*misses)) < 0)
+    return -1;
+  dcachestat(hits, misses);
+  return 0;
+}
+
+// Number of blocks written to the disk since boot.
+int
+sys_diskwrites(void)
+{
+  record_syscall(SYS_diskwrites);
+  return bwrites();
+}
+
+// Set the log's per-transaction block budget, if the
+// argument is > 0; returns the budget in effect.
+int
+sys_logbudget(void)
+{
+  int n;
+  record_syscall(SYS_logbudget);
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return logbudget(n);
+}
+
+// Number of log transactions committed since boot.
+int
+sys_logcommits(void)
+{
+  record_syscall(SYS_logcommits);
+  return logcommits();
+}
+
+// Number of committed blocks not yet written home.
+int
+sys_logpending(void)
+{
+  record_syscall(SYS_logpending);
+  return logpending();
+}
+
 int
 sys_move_file(void) {
-    char *src_file, *dest_dir;
+    char src_file[MAXPATH], dest_dir[MAXPATH];
 
-    if (argstr(0, &src_file) < 0 || argstr(1, &dest_dir) < 0)
+    if (argstr(0, src_file, MAXPATH) < 0 || argstr(1, dest_dir, MAXPATH) < 0)
         return -1;
 
     return move_file(src_file, dest_dir);
 }
 
+// Move src_path to dst_path, or into dst_path if it is a
+// directory, by relinking its directory entry in one
+// transaction; the file's contents are not copied.
 int move_file(char *src_path, char *dst_path) {
-    struct inode* ip_dst;
-    struct inode* ip_src;
-    int bytesRead;
-    char buf[1024];
+    int r;
 
-    if (argstr(0, &src_path) < 0 || argstr(1, &dst_path) < 0)
-        return -1;
-    
     begin_op();
-    if ((ip_src = namei(src_path)) == 0) { 
-        end_op();
-        return -1;
-    }
-    if ((ip_dst = namei(dst_path)) != 0) { 
-        end_op();
-        return -1;
-    }
-    ip_dst = create(dst_path, T_FILE, 0, 0);
-    
-    int bytesWrote = 0;
-    int readOffset = 0;
-    int writeOffset = 0;
-    ilock(ip_src);
-    while ((bytesRead = readi(ip_src, buf, readOffset, sizeof(buf))) > 0) {
-        readOffset += bytesRead;
-        if ((bytesWrote = writei(ip_dst, buf, writeOffset, bytesRead)) <= 0) {
-            iunlock(ip_src);
-            iunlock(ip_dst);
-            end_op();
-            return -1;
-        }
-        writeOffset += bytesWrote;
-    }
-    memset(buf, 0, sizeof(buf));
-    int clearOffset = 0;
-    while (clearOffset < readOffset) {
-        int bytesToWrite = (readOffset - clearOffset > sizeof(buf)) ? sizeof(buf) : readOffset - clearOffset;
-        if (writei(ip_src, buf, clearOffset, bytesToWrite) <= 0) {
-            iunlock(ip_src);
-            iunlock(ip_dst);
-            end_op();
-            return -1;
-        }
-        clearOffset += bytesToWrite;
-    }
-
-    iunlock(ip_src);
-    iunlock(ip_dst);
+    r = rename(src_path, dst_path);
     end_op();
-
-    return 0;
+    return r;
 }
-
-
@@ -7,6 +7,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "syscall.h"
+#include "lockstat.h"
 
 char map[26][30] = {
   "fork", 
@@ -81,16 +82,14 @@ sys_getpid(void)
 int
 sys_sbrk(void)
 {
-  int addr;
   int n;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
   record_syscall(SYS_sbrk);
-  if(growproc(n) < 0)
-    return -1;
-  return addr;
+  // Another thread may grow the memory too: the old size must
+  // be read under the same lock as the growth.
+  return growproc(n);
 }
 
 int
@@ -129,6 +128,101 @@ sys_uptime(void)
   return xticks;
 }
 
+// return how many context switches have occurred
+// since start.
+int
+sys_cswitches(void)
+{
+  record_syscall(SYS_cswitches);
+  return cswitches();
+}
+
+// return how many system calls the children this
+// process has waited for (and theirs) made.
+int
+sys_childsyscalls(void)
+{
+  record_syscall(SYS_childsyscalls);
+  return myproc()->cnsyscall;
+}
+
+int
+sys_clone(void)
+{
+  int fn, arg1, arg2, stack;
+
+  record_syscall(SYS_clone);
+  if(argint(0, &fn) < 0 || argint(1, &arg1) < 0 ||
+     argint(2, &arg2) < 0 || argint(3, &stack) < 0)
+    return -1;
+  return clone((void(*)(void*, void*))fn, (void*)arg1, (void*)arg2,
+               (void*)stack);
+}
+
+int
+sys_join(void)
+{
+  char *p;
+  void *stack;
+  int pid;
+
+  record_syscall(SYS_join);
+  if(argwptr(0, &p, sizeof(void*)) < 0)
+    return -1;
+  if((pid = join(&stack)) < 0)
+    return -1;
+  if(copyout(myproc()->pgdir, (uint)p, &stack, sizeof(stack)) < 0)
+    return -1;
+  return pid;
+}
+
+// Copy the statistics of up to n lock classes to the array
+// at ls and return how many there were, or reset them all if
+// ls is 0.
+int
+sys_lockstat(void)
+{
+  struct lockstat ls;
+  char *p;
+  int i, n;
+
+  record_syscall(SYS_lockstat);
+  if(argint(0, (int*)&p) < 0 || argint(1, &n) < 0)
+    return -1;
+  if(p == 0){
+    lockstatreset();
+    return 0;
+  }
+  if(n < 0 || n > NLOCKCLASS || argwptr(0, &p, n * sizeof(ls)) < 0)
+    return -1;
+  for(i = 0; i < n && lockstatget(i, &ls) == 0; i++)
+    if(copyout(myproc()->pgdir, (uint)p + i * sizeof(ls), &ls, sizeof(ls)) < 0)
+      return -1;
+  return i;
+}
+
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+
+  record_syscall(SYS_futex_wait);
+  if(argint(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futex_wait(addr, val);
+}
+
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+
+  record_syscall(SYS_futex_wake);
+  if(argint(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futex_wake(addr, n);
+}
+
 
 int sort_syscalls(int pid) {
     struct proc *p;
@@ -3,6 +3,78 @@
 #include "user.h"
 #include "fcntl.h"
 
+#define BIGSIZE (300*1024)   // more than one log transaction could copy
+#define MAXMOVEWRITES 30     // a relink touches a few directory and inode blocks
+
+char buf[4096];
+
+static void
+fail(char *msg)
+{
+    printf(2, "test_move_file: %s\n", msg);
+    unlink("mvdir/mvbig");
+    unlink("mvdir/mvback");
+    unlink("mvdir");
+    unlink("mvbig");
+    unlink("mvback");
+    exit();
+}
+
+// Move a large file into a directory and back out under a new
+// name, and check that it arrives whole, that the source name is
+// gone, and that the move does not rewrite the file's blocks.
+// The move is one transaction, committed by the time move_file
+// returns; blocks it left for the lazy checkpoint count too.
+static void
+bigmove(void)
+{
+    struct stat st;
+    int fd, i, n, w0, writes;
+
+    fd = open("mvbig", O_CREATE | O_RDWR);
+    if (fd < 0)
+        fail("cannot create mvbig");
+    for (i = 0; i < BIGSIZE / sizeof(buf); i++) {
+        memset(buf, 'a' + i % 26, sizeof(buf));
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+            fail("write mvbig failed");
+    }
+    close(fd);
+    if (mkdir("mvdir") < 0)
+        fail("mkdir mvdir failed");
+
+    w0 = diskwrites() + logpending();
+    if (move_file("mvbig", "mvdir") < 0)
+        fail("move into directory failed");
+    writes = diskwrites() + logpending() - w0;
+    if (writes > MAXMOVEWRITES)
+        fail("move rewrote the file's blocks");
+    if ((fd = open("mvbig", O_RDONLY)) >= 0) {
+        close(fd);
+        fail("source still there after move");
+    }
+    if (move_file("mvdir/mvbig", "mvback") < 0)
+        fail("move out of directory failed");
+    if (move_file("mvdir", "mvdir/sub") >= 0)
+        fail("moved a directory into itself");
+    if (move_file("mvback", "mvdir") < 0 || move_file("mvdir/mvback", "mvback") < 0)
+        fail("second move failed");
+    if (move_file("nonexistent", "mvdir") >= 0)
+        fail("moved a missing file");
+
+    fd = open("mvback", O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.size != BIGSIZE)
+        fail("moved file has wrong size");
+    for (i = 0; (n = read(fd, buf, sizeof(buf))) > 0; i++) {
+        if (n != sizeof(buf) || buf[0] != 'a' + i % 26 || buf[n-1] != 'a' + i % 26)
+            fail("moved file has wrong contents");
+    }
+    close(fd);
+    unlink("mvback");
+    unlink("mvdir");
+    printf(1, "Moved a %d KB file in %d disk writes\n", BIGSIZE / 1024, writes);
+}
+
 int main() {
     char* src_file="src4";
     char* dest_dir="dst4";
@@ -13,5 +85,6 @@ int main() {
         printf(1, "Successfully moved file from %s to %s\n", src_file, dest_dir);
     }
 
+    bigmove();
     exit();
 }
@@ -26,6 +26,30 @@ tvinit(void)
   initlock(&tickslock, "time");
 }
 
+// Faulting instructions in ucopy.S and their fixups.
+struct ufixup {
+  uint eip;
+  uint fixup;
+};
+extern struct ufixup ufixups[], ufixupsend[];
+
+// If the kernel faulted on a user address in one of the
+// copies in ucopy.S, resume at its fixup.
+static int
+ufixup(struct trapframe *tf)
+{
+  struct ufixup *f;
+
+  if(rcr2() >= KERNBASE)
+    return 0;
+  for(f = ufixups; f < ufixupsend; f++)
+    if(f->eip == tf->eip){
+      tf->eip = f->fixup;
+      return 1;
+    }
+  return 0;
+}
+
 void
 idtinit(void)
 {
@@ -79,6 +103,11 @@ trap(struct trapframe *tf)
     break;
 
   case 14:
+    if((tf->cs&3) == 0 && ufixup(tf))
+      break;
+    // A write to a copy-on-write page.
+    if(myproc() && (tf->err & 2) && uvmcow(myproc()->pgdir, rcr2()) == 0)
+      break;
     if(strncmp(myproc()->name, "testShared", strlen(myproc()->name)) != 0) {
       if(myproc() == 0 || (tf->cs&3) == 0){
         // In kernel, it must be our mistake.
@@ -0,0 +1,7 @@
+// A segment of memory for readv() and writev().
+struct iovec {
+  void *iov_base;  // start of segment
+  int iov_len;     // length of segment in bytes
+};
+
+#define IOV_MAX 16  // most segments in one readv() or writev()
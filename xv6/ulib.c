@@ -4,6 +4,40 @@
 #include "user.h"
 #include "x86.h"
 
+// As in the kernel's string.c, the primitives below move
+// aligned words rather than bytes unless built with -DSTRFAST=0.
+#ifndef STRFAST
+#define STRFAST 1
+#endif
+
+#define ONES  0x01010101
+#define HIGHS 0x80808080
+#define HASZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+int _fork(void);
+int _exit(void) __attribute__((noreturn));
+
+// Set by stdio.c once a stream holds buffered output, so that
+// it is written out before the process exits, and before fork()
+// could give the child a copy of it too.
+void (*stdioflush)(void);
+
+int
+fork(void)
+{
+  if(stdioflush)
+    stdioflush();
+  return _fork();
+}
+
+int
+exit(void)
+{
+  if(stdioflush)
+    stdioflush();
+  _exit();
+}
+
 char*
 strcpy(char *s, const char *t)
 {
@@ -18,6 +52,14 @@ strcpy(char *s, const char *t)
 int
 strcmp(const char *p, const char *q)
 {
+  if(STRFAST && ((uint)p & 3) == ((uint)q & 3)){
+    for(; (uint)p & 3; p++, q++)
+      if(*p == 0 || *p != *q)
+        return (uchar)*p - (uchar)*q;
+    // Equal words without a zero byte.
+    while(*(uint*)p == *(uint*)q && !HASZERO(*(uint*)p))
+      p += 4, q += 4;
+  }
   while(*p && *p == *q)
     p++, q++;
   return (uchar)*p - (uchar)*q;
@@ -26,17 +68,38 @@ strcmp(const char *p, const char *q)
 uint
 strlen(const char *s)
 {
-  int n;
+  const char *p;
 
-  for(n = 0; s[n]; n++)
-    ;
-  return n;
+  p = s;
+  if(STRFAST){
+    for(; (uint)p & 3; p++)
+      if(*p == 0)
+        return p - s;
+    while(!HASZERO(*(uint*)p))
+      p += 4;
+  }
+  while(*p)
+    p++;
+  return p - s;
 }
 
 void*
 memset(void *dst, int c, uint n)
 {
-  stosb(dst, c, n);
+  char *d;
+
+  d = dst;
+  c &= 0xFF;
+  if(STRFAST && n >= 16){
+    while((uint)d & 3){
+      *d++ = c;
+      n--;
+    }
+    stosl(d, c * ONES, n/4);
+    d += n & ~3;
+    n &= 3;
+  }
+  stosb(d, c, n);
   return dst;
 }
 
@@ -49,24 +112,6 @@ strchr(const char *s, char c)
   return 0;
 }
 
-char*
-gets(char *buf, int max)
-{
-  int i, cc;
-  char c;
-
-  for(i=0; i+1 < max; ){
-    cc = read(0, &c, 1);
-    if(cc < 1)
-      break;
-    buf[i++] = c;
-    if(c == '\n' || c == '\r')
-      break;
-  }
-  buf[i] = '\0';
-  return buf;
-}
-
 int
 stat(const char *n, struct stat *st)
 {
@@ -100,6 +145,30 @@ memmove(void *vdst, const void *vsrc, int n)
 
   dst = vdst;
   src = vsrc;
+  if(src < dst && src + n > dst){
+    // Overlapping from above: copy backward.
+    dst += n;
+    src += n;
+    if(STRFAST)
+      for(; n >= 4; n -= 4){
+        dst -= 4;
+        src -= 4;
+        *(uint*)dst = *(uint*)src;
+      }
+    while(n-- > 0)
+      *--dst = *--src;
+    return vdst;
+  }
+  if(STRFAST && n >= 16){
+    while((uint)dst & 3){
+      *dst++ = *src++;
+      n--;
+    }
+    movsl(dst, src, n/4);
+    dst += n & ~3;
+    src += n & ~3;
+    n &= 3;
+  }
   while(n-- > 0)
     *dst++ = *src++;
   return vdst;
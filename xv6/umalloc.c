@@ -3,88 +3,363 @@
 #include "user.h"
 #include "param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator.
+//
+// Small requests (up to NSMALL bytes with their header) are
+// served from size classes of powers of two: each class keeps
+// a list of free chunks, so malloc() and free() take constant
+// time. Chunks are carved out of slabs taken from the large
+// allocator and are never merged back.
+//
+// Larger requests are blocks in the heap obtained with sbrk().
+// Every block has a header holding its size and the size of
+// the block before it, so free() can merge a block with both
+// neighbours without searching. Free blocks are kept in a
+// binary tree ordered by size (then address), from which
+// malloc() takes the best fit. When a free block at the top
+// of the heap grows past TRIM bytes, most of it is given back
+// to the kernel with a negative sbrk().
+//
+// Threads allocate from NARENA arenas, each with its own lock,
+// bins, tree and heap segments. A thread picks one by hashing
+// its stack page (every thread has a page of its own), so
+// threads seldom contend for a lock. A freed block goes back
+// to the arena it came from, whichever thread frees it: a
+// small chunk's unused prev field holds its arena, and a large
+// block's payload starts with a second header that does.
 
-typedef long Align;
+struct hdr {
+  uint size;        // bytes in block, with header; low bits are flags
+  uint prev;        // size of the block before it; 0 if first in segment;
+                    // a small chunk's arena
+};
+
+#define INUSE    1     // block is allocated
+#define SMALL    2     // block is a size-class chunk
+#define FLAGS    (INUSE|SMALL)
+#define BSIZE(h) ((h)->size & ~FLAGS)
 
-union header {
-  struct {
-    union header *ptr;
-    uint size;
-  } s;
-  Align x;
+// A free large block; the tree links live in its payload.
+struct node {
+  struct hdr h;
+  struct node *left, *right, *parent;
 };
 
-typedef union header Header;
+#define NCLASS   8
+#define MINCLASS 16                        // smallest chunk, with header
+#define NSMALL   (MINCLASS << (NCLASS-1))  // largest chunk, with header
+#define MINLARGE 32        // smallest large block worth splitting off
+#define GROW     (16*1024) // least heap growth per sbrk()
+#define TRIM     (64*1024) // free top block size that is given back
+#define KEEP     (16*1024) // what stays after trimming
+#define NARENA   4
 
-static Header base;
-static Header *freep;
+struct arena {
+  lock_t lock;
+  void *bins[NCLASS];  // free chunks of each class, linked through payload
+  struct node *root;   // free large blocks
+  struct hdr *top;     // epilogue of the newest heap segment
+};
 
-void
-free(void *ap)
+static struct arena arenas[NARENA];
+
+static struct hdr*
+next(struct hdr *h)
 {
-  Header *bp, *p;
-
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+  return (struct hdr*)((char*)h + BSIZE(h));
+}
+
+//PAGEBREAK!
+// The tree of free large blocks.
+
+static int
+less(struct node *a, struct node *b)
+{
+  return BSIZE(&a->h) < BSIZE(&b->h) ||
+         (BSIZE(&a->h) == BSIZE(&b->h) && a < b);
+}
+
+static void
+insert(struct arena *a, struct node *n)
+{
+  struct node **pp, *parent;
+
+  parent = 0;
+  for(pp = &a->root; *pp; pp = less(n, *pp) ? &(*pp)->left : &(*pp)->right)
+    parent = *pp;
+  n->left = n->right = 0;
+  n->parent = parent;
+  *pp = n;
+}
+
+// Replace n by c (which may be 0) in its parent.
+static void
+replace(struct arena *a, struct node *n, struct node *c)
+{
+  if(c)
+    c->parent = n->parent;
+  if(n->parent == 0)
+    a->root = c;
+  else if(n->parent->left == n)
+    n->parent->left = c;
+  else
+    n->parent->right = c;
+}
+
+static void
+delete(struct arena *a, struct node *n)
+{
+  struct node *s;
+
+  if(n->left == 0)
+    replace(a, n, n->right);
+  else if(n->right == 0)
+    replace(a, n, n->left);
+  else {
+    // Put n's successor, the leftmost node on its right, in its place.
+    for(s = n->right; s->left; s = s->left)
+      ;
+    if(s->parent != n){
+      replace(a, s, s->right);
+      s->right = n->right;
+      s->right->parent = s;
+    }
+    replace(a, n, s);
+    s->left = n->left;
+    s->left->parent = s;
+  }
+}
+
+// The smallest free block of at least size bytes.
+static struct node*
+bestfit(struct arena *a, uint size)
+{
+  struct node *n, *best;
+
+  best = 0;
+  for(n = a->root; n; ){
+    if(BSIZE(&n->h) >= size){
+      best = n;
+      n = n->left;
+    } else
+      n = n->right;
+  }
+  return best;
+}
+
+//PAGEBREAK!
+// Large blocks.
+
+// Give a free block back to the tree, merging it with free
+// neighbours and, if trim is set, trimming the heap if the
+// block ends up on top.
+static void
+release(struct arena *a, struct hdr *h, int trim)
+{
+  struct hdr *n, *p;
+  uint r;
+
+  h->size &= ~FLAGS;
+  n = next(h);
+  if(!(n->size & INUSE)){
+    delete(a, (struct node*)n);
+    h->size += BSIZE(n);
+  }
+  if(h->prev){
+    p = (struct hdr*)((char*)h - h->prev);
+    if(!(p->size & INUSE)){
+      delete(a, (struct node*)p);
+      p->size += BSIZE(h);
+      h = p;
+    }
+  }
+  n = next(h);
+  if(trim && n == a->top && BSIZE(h) >= TRIM && (char*)(n+1) == sbrk(0)){
+    r = (BSIZE(h) - KEEP) & ~(4096-1);
+    h->size -= r;
+    n = next(h);
+    n->size = INUSE;
+    if(sbrk(-r) != (char*)-1)
+      a->top = n;
+    else
+      h->size += r;
+    n = next(h);
+  }
+  n->prev = BSIZE(h);
+  insert(a, (struct node*)h);
 }
 
-static Header*
-morecore(uint nu)
+// Add at least size bytes to the heap. A new stretch that
+// follows on from the last one joins it; otherwise (someone
+// else called sbrk()) it starts a new segment.
+static int
+grow(struct arena *a, uint size)
 {
+  struct hdr *h, *e;
+  uint n;
   char *p;
-  Header *hp;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == (char*)-1)
-    return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  // sbrk() takes an int; more would shrink the heap.
+  if(size > 0x7fffffff - 3*sizeof(struct hdr))
+    return -1;
+  n = size + 3*sizeof(struct hdr);
+  if(n < GROW)
+    n = GROW;
+  if((p = sbrk(n)) == (char*)-1){
+    n = size + 3*sizeof(struct hdr);
+    if((p = sbrk(n)) == (char*)-1)
+      return -1;
+  }
+  if(a->top && (char*)(a->top + 1) == p){
+    // The old epilogue becomes the new block's header.
+    h = a->top;
+    n += sizeof(struct hdr);
+  } else {
+    // Someone else may have left sbrk() unaligned.
+    while((uint)p % 8){
+      p++;
+      n--;
+    }
+    n &= ~7;
+    h = (struct hdr*)p;
+    h->prev = 0;
+  }
+  h->size = n - sizeof(struct hdr);
+  e = next(h);
+  e->size = INUSE;
+  e->prev = BSIZE(h);
+  a->top = e;
+  release(a, h, 0);
+  return 0;
+}
+
+static void*
+malloclarge(struct arena *a, uint size)
+{
+  struct node *b;
+  struct hdr *h, *r;
+
+  size = (size + sizeof(struct hdr) + 7) & ~7;
+  if(size < MINLARGE)
+    size = MINLARGE;
+  if((b = bestfit(a, size)) == 0){
+    if(grow(a, size) < 0)
+      return 0;
+    b = bestfit(a, size);
+  }
+  delete(a, b);
+  h = &b->h;
+  if(BSIZE(h) - size >= MINLARGE){
+    // Split off the rest as a free block of its own.
+    r = (struct hdr*)((char*)h + size);
+    r->size = BSIZE(h) - size;
+    r->prev = size;
+    next(r)->prev = BSIZE(r);
+    h->size = size;
+    insert(a, (struct node*)r);
+  }
+  h->size |= INUSE;
+  return h + 1;
+}
+
+//PAGEBREAK!
+// Size classes.
+
+static int
+sizeclass(uint size)
+{
+  int c;
+
+  for(c = 0; (MINCLASS << c) < size; c++)
+    ;
+  return c;
+}
+
+// Fill class c's list with the chunks of a new slab.
+static int
+refill(struct arena *a, int c)
+{
+  uint csize, n;
+  char *p, *end;
+  struct hdr *h;
+
+  csize = MINCLASS << c;
+  n = 4096;
+  if(n < 8*csize)
+    n = 8*csize;
+  if((p = malloclarge(a, n)) == 0)
+    return -1;
+  for(end = p + n; p + csize <= end; p += csize){
+    h = (struct hdr*)p;
+    h->size = csize | SMALL | INUSE;
+    h->prev = (uint)a;
+    *(void**)(h + 1) = a->bins[c];
+    a->bins[c] = h + 1;
+  }
+  return 0;
+}
+
+//PAGEBREAK!
+// Arenas.
+
+// The calling thread's arena.
+static struct arena*
+myarena(void)
+{
+  int sp;
+
+  return &arenas[((uint)&sp / 4096) % NARENA];
+}
+
+void
+free(void *ap)
+{
+  struct arena *a;
+  struct hdr *h;
+  int c;
+
+  if(ap == 0)
+    return;
+  h = (struct hdr*)ap - 1;
+  a = (struct arena*)h->prev;
+  lock_acquire(&a->lock);
+  if(h->size & SMALL){
+    c = sizeclass(BSIZE(h));
+    *(void**)ap = a->bins[c];
+    a->bins[c] = ap;
+  } else
+    release(a, h - 1, 1);
+  lock_release(&a->lock);
 }
 
 void*
 malloc(uint nbytes)
 {
-  Header *p, *prevp;
-  uint nunits;
+  struct arena *a;
+  struct hdr *h;
+  void *p;
+  int c;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
-  }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
+  a = myarena();
+  if(nbytes > 0x7fffffff)
+    return 0;
+  lock_acquire(&a->lock);
+  if(nbytes + sizeof(struct hdr) > NSMALL){
+    if((h = malloclarge(a, nbytes + sizeof(struct hdr))) != 0){
+      h->size = INUSE;
+      h->prev = (uint)a;
+      h++;
+    }
+    p = h;
+  } else {
+    c = sizeclass(nbytes + sizeof(struct hdr));
+    if(a->bins[c] == 0 && refill(a, c) < 0)
+      p = 0;
+    else {
+      p = a->bins[c];
+      a->bins[c] = *(void**)p;
     }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
   }
+  lock_release(&a->lock);
+  return p;
 }
@@ -1,5 +1,8 @@
 struct stat;
 struct rtcdate;
+struct iovec;
+struct spawnact;
+struct lockstat;
 struct proc;
 
 // system calls
@@ -32,6 +35,26 @@ int move_file(const char *src_file, const char *dest_dir);
 void find_palindrome(int);
 int open_sharedmem(int);
 int close_sharedmem(void*);
+int diskwrites(void);
+int namestat(uint*, uint*);
+int splice(int, int, int);
+int fcntl(int, int, int);
+int cswitches(void);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, void*, int, int);
+int logbudget(int);
+int logcommits(void);
+int logpending(void);
+int copy_file_range(int, int, int);
+int childsyscalls(void);
+int spawn(char*, char**, struct spawnact*, int);
+int clone(void(*)(void*, void*), void*, void*, void*);
+int join(void**);
+int futex_wait(uint*, uint);
+int futex_wake(uint*, int);
+int lockstat(struct lockstat*, int);
 
 
 // ulib.c
@@ -41,9 +64,76 @@ void *memmove(void*, const void*, int);
 char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
 void printf(int, const char*, ...);
-char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+
+// uthread.c
+typedef struct {
+  uint locked;
+} lock_t;
+
+typedef struct {
+  uint state;         // 0 unlocked, 1 locked, 2 locked with waiters
+} mutex_t;
+
+typedef struct {
+  uint seq;           // bumped by every signal
+} cond_t;
+
+void lock_init(lock_t*);
+void lock_acquire(lock_t*);
+void lock_release(lock_t*);
+void mutex_init(mutex_t*);
+void mutex_lock(mutex_t*);
+void mutex_unlock(mutex_t*);
+void cond_init(cond_t*);
+void cond_wait(cond_t*, mutex_t*);
+void cond_signal(cond_t*);
+void cond_broadcast(cond_t*);
+int thread_create(void(*)(void*, void*), void*, void*);
+int thread_join(void);
+
+// stdio.c: buffered streams
+#define BUFSIZ  512
+#define EOF     (-1)
+#define _IOFBF  0     // fully buffered
+#define _IOLBF  1     // line buffered
+#define _IONBF  2     // unbuffered
+
+#define _FREAD   0x1   // opened for reading
+#define _FWRITE  0x2   // opened for writing
+#define _FEOF    0x4   // read reached end of file
+#define _FERR    0x8   // read or write failed
+#define _FMYBUF  0x10  // buf was malloc'ed by stdio
+
+typedef struct {
+  int fd;
+  int flags;          // _FREAD, _FWRITE, ...; 0 if free
+  int mode;           // _IOFBF, _IOLBF, _IONBF, or -1 until first use
+  char *buf;
+  int size;
+  int pos;            // next byte to read, or bytes waiting to be written
+  int len;            // bytes in buf, when reading
+  char ch;            // one-byte buffer for unbuffered reads
+} FILE;
+
+extern FILE *stdin, *stdout, *stderr;
+
+FILE* fopen(const char*, const char*);
+FILE* fdopen(int, const char*);
+int fclose(FILE*);
+int fflush(FILE*);
+int setvbuf(FILE*, char*, int, int);
+int fgetc(FILE*);
+int fputc(int, FILE*);
+char* fgets(char*, int, FILE*);
+char* gets(char*, int max);
+int fputs(const char*, FILE*);
+int fread(void*, int, int, FILE*);
+int fwrite(const void*, int, int, FILE*);
+int feof(FILE*);
+int ferror(FILE*);
+void fprintf(FILE*, const char*, ...);
@@ -7,35 +7,36 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "uio.h"
+#include "spawn.h"
 
 char buf[8192];
 char name[3];
 char *echoargv[] = { "echo", "ALL", "TESTS", "PASSED", 0 };
-int stdout = 1;
 
 // does chdir() call iput(p->cwd) in a transaction?
 void
 iputtest(void)
 {
-  printf(stdout, "iput test\n");
+  printf(1, "iput test\n");
 
   if(mkdir("iputdir") < 0){
-    printf(stdout, "mkdir failed\n");
+    printf(1, "mkdir failed\n");
     exit();
   }
   if(chdir("iputdir") < 0){
-    printf(stdout, "chdir iputdir failed\n");
+    printf(1, "chdir iputdir failed\n");
     exit();
   }
   if(unlink("../iputdir") < 0){
-    printf(stdout, "unlink ../iputdir failed\n");
+    printf(1, "unlink ../iputdir failed\n");
     exit();
   }
   if(chdir("/") < 0){
-    printf(stdout, "chdir / failed\n");
+    printf(1, "chdir / failed\n");
     exit();
   }
-  printf(stdout, "iput test ok\n");
+  printf(1, "iput test ok\n");
 }
 
 // does exit() call iput(p->cwd) in a transaction?
@@ -44,30 +45,30 @@ exitiputtest(void)
 {
   int pid;
 
-  printf(stdout, "exitiput test\n");
+  printf(1, "exitiput test\n");
 
   pid = fork();
   if(pid < 0){
-    printf(stdout, "fork failed\n");
+    printf(1, "fork failed\n");
     exit();
   }
   if(pid == 0){
     if(mkdir("iputdir") < 0){
-      printf(stdout, "mkdir failed\n");
+      printf(1, "mkdir failed\n");
       exit();
     }
     if(chdir("iputdir") < 0){
-      printf(stdout, "child chdir failed\n");
+      printf(1, "child chdir failed\n");
       exit();
     }
     if(unlink("../iputdir") < 0){
-      printf(stdout, "unlink ../iputdir failed\n");
+      printf(1, "unlink ../iputdir failed\n");
       exit();
     }
     exit();
   }
   wait();
-  printf(stdout, "exitiput test ok\n");
+  printf(1, "exitiput test ok\n");
 }
 
 // does the error path in open() for attempt to write a
@@ -86,31 +87,31 @@ openiputtest(void)
 {
   int pid;
 
-  printf(stdout, "openiput test\n");
+  printf(1, "openiput test\n");
   if(mkdir("oidir") < 0){
-    printf(stdout, "mkdir oidir failed\n");
+    printf(1, "mkdir oidir failed\n");
     exit();
   }
   pid = fork();
   if(pid < 0){
-    printf(stdout, "fork failed\n");
+    printf(1, "fork failed\n");
     exit();
   }
   if(pid == 0){
     int fd = open("oidir", O_RDWR);
     if(fd >= 0){
-      printf(stdout, "open directory for write succeeded\n");
+      printf(1, "open directory for write succeeded\n");
       exit();
     }
     exit();
   }
   sleep(1);
   if(unlink("oidir") != 0){
-    printf(stdout, "unlink failed\n");
+    printf(1, "unlink failed\n");
     exit();
   }
   wait();
-  printf(stdout, "openiput test ok\n");
+  printf(1, "openiput test ok\n");
 }
 
 // simple file system tests
@@ -120,19 +121,19 @@ opentest(void)
 {
   int fd;
 
-  printf(stdout, "open test\n");
+  printf(1, "open test\n");
   fd = open("echo", 0);
   if(fd < 0){
-    printf(stdout, "open echo failed!\n");
+    printf(1, "open echo failed!\n");
     exit();
   }
   close(fd);
   fd = open("doesnotexist", 0);
   if(fd >= 0){
-    printf(stdout, "open doesnotexist succeeded!\n");
+    printf(1, "open doesnotexist succeeded!\n");
     exit();
   }
-  printf(stdout, "open test ok\n");
+  printf(1, "open test ok\n");
 }
 
 void
@@ -141,66 +142,69 @@ writetest(void)
   int fd;
   int i;
 
-  printf(stdout, "small file test\n");
+  printf(1, "small file test\n");
   fd = open("small", O_CREATE|O_RDWR);
   if(fd >= 0){
-    printf(stdout, "creat small succeeded; ok\n");
+    printf(1, "creat small succeeded; ok\n");
   } else {
-    printf(stdout, "error: creat small failed!\n");
+    printf(1, "error: creat small failed!\n");
     exit();
   }
   for(i = 0; i < 100; i++){
     if(write(fd, "aaaaaaaaaa", 10) != 10){
-      printf(stdout, "error: write aa %d new file failed\n", i);
+      printf(1, "error: write aa %d new file failed\n", i);
       exit();
     }
     if(write(fd, "bbbbbbbbbb", 10) != 10){
-      printf(stdout, "error: write bb %d new file failed\n", i);
+      printf(1, "error: write bb %d new file failed\n", i);
       exit();
     }
   }
-  printf(stdout, "writes ok\n");
+  printf(1, "writes ok\n");
   close(fd);
   fd = open("small", O_RDONLY);
   if(fd >= 0){
-    printf(stdout, "open small succeeded ok\n");
+    printf(1, "open small succeeded ok\n");
   } else {
-    printf(stdout, "error: open small failed!\n");
+    printf(1, "error: open small failed!\n");
     exit();
   }
   i = read(fd, buf, 2000);
   if(i == 2000){
-    printf(stdout, "read succeeded ok\n");
+    printf(1, "read succeeded ok\n");
   } else {
-    printf(stdout, "read failed\n");
+    printf(1, "read failed\n");
     exit();
   }
   close(fd);
 
   if(unlink("small") < 0){
-    printf(stdout, "unlink small failed\n");
+    printf(1, "unlink small failed\n");
     exit();
   }
-  printf(stdout, "small file test ok\n");
+  printf(1, "small file test ok\n");
 }
 
+// Reaches well into the double-indirect blocks.
+#define BIGFILE (NDIRECT + NINDIRECT + 4*NINDIRECT)
+
 void
 writetest1(void)
 {
   int i, fd, n;
 
-  printf(stdout, "big files test\n");
+  printf(1, "big files test\n");
 
   fd = open("big", O_CREATE|O_RDWR);
   if(fd < 0){
-    printf(stdout, "error: creat big failed!\n");
+    printf(1, "error: creat big failed!\n");
     exit();
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < BIGFILE; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, 512) != 512){
-      printf(stdout, "error: write big file failed\n", i);
+      printf(1, "error: write big file failed\n", i);
       exit();
     }
   }
@@ -209,7 +213,7 @@ writetest1(void)
 
   fd = open("big", O_RDONLY);
   if(fd < 0){
-    printf(stdout, "error: open big failed!\n");
+    printf(1, "error: open big failed!\n");
     exit();
   }
 
@@ -217,17 +221,17 @@ writetest1(void)
   for(;;){
     i = read(fd, buf, 512);
     if(i == 0){
-      if(n == MAXFILE - 1){
-        printf(stdout, "read only %d blocks from big", n);
+      if(n != BIGFILE){
+        printf(1, "read only %d blocks from big", n);
         exit();
       }
       break;
     } else if(i != 512){
-      printf(stdout, "read failed %d\n", i);
+      printf(1, "read failed %d\n", i);
       exit();
     }
     if(((int*)buf)[0] != n){
-      printf(stdout, "read content of block %d is %d\n",
+      printf(1, "read content of block %d is %d\n",
              n, ((int*)buf)[0]);
       exit();
     }
@@ -235,10 +239,10 @@ writetest1(void)
   }
   close(fd);
   if(unlink("big") < 0){
-    printf(stdout, "unlink big failed\n");
+    printf(1, "unlink big failed\n");
     exit();
   }
-  printf(stdout, "big files ok\n");
+  printf(1, "big files ok\n");
 }
 
 void
@@ -246,7 +250,7 @@ createtest(void)
 {
   int i, fd;
 
-  printf(stdout, "many creates, followed by unlink test\n");
+  printf(1, "many creates, followed by unlink test\n");
 
   name[0] = 'a';
   name[2] = '\0';
@@ -261,41 +265,313 @@ createtest(void)
     name[1] = '0' + i;
     unlink(name);
   }
-  printf(stdout, "many creates, followed by unlink; ok\n");
+  printf(1, "many creates, followed by unlink; ok\n");
 }
 
 void dirtest(void)
 {
-  printf(stdout, "mkdir test\n");
+  printf(1, "mkdir test\n");
 
   if(mkdir("dir0") < 0){
-    printf(stdout, "mkdir failed\n");
+    printf(1, "mkdir failed\n");
     exit();
   }
 
   if(chdir("dir0") < 0){
-    printf(stdout, "chdir dir0 failed\n");
+    printf(1, "chdir dir0 failed\n");
     exit();
   }
 
   if(chdir("..") < 0){
-    printf(stdout, "chdir .. failed\n");
+    printf(1, "chdir .. failed\n");
     exit();
   }
 
   if(unlink("dir0") < 0){
-    printf(stdout, "unlink dir0 failed\n");
+    printf(1, "unlink dir0 failed\n");
+    exit();
+  }
+  printf(1, "mkdir test ok\n");
+}
+
+// spawn starts a program with its own redirections,
+// without forking.
+void
+spawntest(void)
+{
+  struct spawnact act[3];
+  int fd, n, p[2];
+
+  printf(1, "spawn test\n");
+  unlink("spawnout");
+  act[0].op = SPAWN_OPEN;
+  act[0].fd = 1;
+  act[0].arg = O_CREATE|O_WRONLY;
+  act[0].path = "spawnout";
+  if(spawn("echo", echoargv, act, 1) < 0 || wait() < 0){
+    printf(1, "spawn echo failed\n");
+    exit();
+  }
+  fd = open("spawnout", 0);
+  n = read(fd, buf, sizeof(buf));
+  close(fd);
+  unlink("spawnout");
+  buf[n < 0 ? 0 : n] = 0;
+  if(strcmp(buf, "ALL TESTS PASSED\n") != 0){
+    printf(1, "spawn: wrong output\n");
+    exit();
+  }
+
+  // The child's end of a pipe, with the parent's ends closed.
+  if(pipe(p) < 0){
+    printf(1, "spawn: pipe failed\n");
+    exit();
+  }
+  act[0].op = SPAWN_DUP2;
+  act[0].fd = 1;
+  act[0].arg = p[1];
+  act[1].op = SPAWN_CLOSE;
+  act[1].fd = p[0];
+  act[2].op = SPAWN_CLOSE;
+  act[2].fd = p[1];
+  if(spawn("echo", echoargv, act, 3) < 0){
+    printf(1, "spawn echo to pipe failed\n");
+    exit();
+  }
+  close(p[1]);
+  for(n = 0; read(p[0], buf+n, 1) == 1; n++)
+    ;
+  close(p[0]);
+  wait();
+  if(n == 0){
+    printf(1, "spawn: nothing through the pipe\n");
+    exit();
+  }
+
+  act[0].op = SPAWN_CLOSE;
+  act[0].fd = NOFILE;
+  if(spawn("echo", echoargv, act, 1) >= 0 || spawn("nosuchprog", echoargv, 0, 0) >= 0){
+    printf(1, "spawn: bad spawn succeeded\n");
+    exit();
+  }
+  if(wait() >= 0){
+    printf(1, "spawn: failed spawn left a child\n");
+    exit();
+  }
+  printf(1, "spawn test ok\n");
+}
+
+// Run prog with output to a file and return the output in buf.
+static int
+runout(char *prog, char **argv)
+{
+  struct spawnact act;
+  int fd, n;
+
+  unlink("textout");
+  act.op = SPAWN_OPEN;
+  act.fd = 1;
+  act.arg = O_CREATE|O_WRONLY;
+  act.path = "textout";
+  if(spawn(prog, argv, &act, 1) < 0 || wait() < 0)
+    return -1;
+  fd = open("textout", 0);
+  n = read(fd, buf, sizeof(buf)-1);
+  close(fd);
+  unlink("textout");
+  buf[n < 0 ? 0 : n] = 0;
+  return n;
+}
+
+// Overwrite file dst with file src.
+static void
+copyprog(char *src, char *dst)
+{
+  int fd, fd1;
+
+  fd = open(src, 0);
+  fd1 = open(dst, O_CREATE|O_WRONLY);
+  if(fd < 0 || fd1 < 0 || copy_file_range(fd, fd1, 100000) <= 0){
+    printf(1, "textcache: copy %s failed\n", src);
+    exit();
+  }
+  close(fd);
+  close(fd1);
+}
+
+// exec caches program pages; rewriting the program must
+// drop them.
+void
+textcache(void)
+{
+  char *argv[] = { "tprog", "hello", 0 };
+  int i;
+
+  printf(1, "text cache test\n");
+  unlink("tprog");
+  copyprog("echo", "tprog");
+  for(i = 0; i < 3; i++){
+    if(runout("tprog", argv) < 0 || strcmp(buf, "hello\n") != 0){
+      printf(1, "textcache: tprog as echo failed\n");
+      exit();
+    }
+  }
+  copyprog("wc", "tprog");
+  if(runout("tprog", argv) < 0 || strcmp(buf, "hello\n") == 0){
+    printf(1, "textcache: stale program after rewrite\n");
+    exit();
+  }
+  unlink("tprog");
+  printf(1, "text cache test ok\n");
+}
+
+int cowdata = 7;
+
+// Program text is mapped read-only and data copy-on-write,
+// both shared with the program cache.
+void
+textprot(void)
+{
+  int fd, pid;
+
+  printf(1, "text protection test\n");
+  fd = open("echo", 0);
+  if(fd < 0){
+    printf(1, "textprot: open echo failed\n");
+    exit();
+  }
+  if(read(fd, (char*)(uint)textprot, 4) != -1){
+    printf(1, "textprot: read into text succeeded\n");
+    exit();
+  }
+  pid = fork();
+  if(pid == 0){
+    cowdata = 8;
+    exit();
+  }
+  wait();
+  if(cowdata != 7){
+    printf(1, "textprot: child's write showed in parent\n");
+    exit();
+  }
+  if(read(fd, (char*)&cowdata, 4) != 4 || cowdata == 7){
+    printf(1, "textprot: read into data failed\n");
+    exit();
+  }
+  close(fd);
+  printf(1, "text protection test ok\n");
+}
+
+lock_t tlock;
+volatile int tcount, tfd, tgo;
+
+void
+threadwork(void *arg1, void *arg2)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++){
+    lock_acquire(&tlock);
+    tcount += (int)arg1;
+    lock_release(&tlock);
+  }
+  if(arg2)
+    tfd = open("echo", 0);
+  while(tgo == 0)
+    ;
+  exit();
+}
+
+// Threads share memory and open files, and are collected
+// by join(), not wait().
+void
+threadtest(void)
+{
+  int i;
+
+  printf(1, "thread test\n");
+  lock_init(&tlock);
+  tcount = 0;
+  tfd = -1;
+  tgo = 0;
+  for(i = 0; i < 4; i++){
+    if(thread_create(threadwork, (void*)1, (void*)(i == 0)) < 0){
+      printf(1, "thread_create failed\n");
+      exit();
+    }
+  }
+  while(tcount != 4000 || tfd < 0)
+    ;
+  if(wait() != -1){
+    printf(1, "threadtest: wait found a thread\n");
+    exit();
+  }
+  if(exec("echo", echoargv) != -1){
+    printf(1, "threadtest: exec with threads running succeeded\n");
+    exit();
+  }
+  if(read(tfd, buf, 4) != 4 || close(tfd) != 0){
+    printf(1, "threadtest: thread's file not shared\n");
+    exit();
+  }
+  tgo = 1;
+  for(i = 0; i < 4; i++){
+    if(thread_join() < 0){
+      printf(1, "thread_join failed\n");
+      exit();
+    }
+  }
+  if(thread_join() != -1 || clone(threadwork, 0, 0, (void*)1) != -1){
+    printf(1, "threadtest: bad join or clone succeeded\n");
+    exit();
+  }
+  printf(1, "thread test ok\n");
+}
+
+uint fword;
+
+void
+futexwaiter(void *arg1, void *arg2)
+{
+  if(futex_wait(&fword, 0) != 0){
+    printf(1, "futex_wait not woken\n");
+    exit();
+  }
+  exit();
+}
+
+void
+futextest(void)
+{
+  int n;
+
+  printf(1, "futex test\n");
+  fword = 1;
+  if(futex_wait(&fword, 0) != -1 || futex_wait((uint*)((char*)&fword + 1), 1) != -1){
+    printf(1, "futextest: futex_wait should have failed\n");
+    exit();
+  }
+  fword = 0;
+  if(thread_create(futexwaiter, 0, 0) < 0){
+    printf(1, "futextest: thread_create failed\n");
+    exit();
+  }
+  // Retry until the thread is asleep.
+  while((n = futex_wake(&fword, 1)) == 0)
+    sleep(1);
+  if(n != 1 || thread_join() < 0){
+    printf(1, "futextest: wake failed\n");
     exit();
   }
-  printf(stdout, "mkdir test ok\n");
+  printf(1, "futex test ok\n");
 }
 
 void
 exectest(void)
 {
-  printf(stdout, "exec test\n");
+  printf(1, "exec test\n");
   if(exec("echo", echoargv) < 0){
-    printf(stdout, "exec echo failed\n");
+    printf(1, "exec echo failed\n");
     exit();
   }
 }
@@ -457,6 +733,57 @@ mem(void)
   }
 }
 
+// malloc() microbenchmark: time small allocations freed in
+// LIFO order and a random mix of sizes with many blocks live,
+// checking that no block is handed out twice.
+#define NLIVE 400
+
+void
+mallocbench(void)
+{
+  static char *live[NLIVE];
+  static uint sz[NLIVE];
+  uint i, j, k, t0, rnd;
+  char *p;
+
+  printf(1, "malloc bench\n");
+  t0 = uptime();
+  for(i = 0; i < 20000; i++){
+    for(j = 0; j < 8; j++)
+      live[j] = malloc(8 << j);
+    for(j = 8; j-- > 0; )
+      free(live[j]);
+  }
+  printf(1, "malloc bench: 320000 small malloc/free in %d ticks\n", uptime() - t0);
+
+  t0 = uptime();
+  rnd = 1;
+  for(i = 0; i < 100000; i++){
+    rnd = rnd * 1103515245 + 12345;
+    k = (rnd >> 8) % NLIVE;
+    if((p = live[k]) != 0){
+      for(j = 0; j < sz[k]; j += 64)
+        if(p[j] != (char)k){
+          printf(1, "malloc bench: block %d corrupted\n", k);
+          exit();
+        }
+      free(p);
+      live[k] = 0;
+    } else {
+      sz[k] = (rnd >> 16) % 8 == 0 ? (rnd >> 4) % 20000 : (rnd >> 4) % 200;
+      if((live[k] = malloc(sz[k])) == 0){
+        printf(1, "malloc bench: out of memory\n");
+        exit();
+      }
+      memset(live[k], k, sz[k]);
+    }
+  }
+  for(k = 0; k < NLIVE; k++)
+    free(live[k]);
+  printf(1, "malloc bench: 100000 mixed malloc/free in %d ticks, heap %d KB\n",
+         uptime() - t0, (uint)sbrk(0) / 1024);
+}
+
 // More file system tests
 
 // two processes write to the same file descriptor
@@ -1373,6 +1700,191 @@ iref(void)
   printf(1, "empty file name OK\n");
 }
 
+// more inodes open at once than the inode cache
+// started out with (NINODE is 50)
+static int
+samebytes(char *a, char *b, int n)
+{
+  while(n-- > 0)
+    if(*a++ != *b++)
+      return 0;
+  return 1;
+}
+
+// readv/writev gather and scatter across segments, and
+// pread/pwrite use their own offset, not the file's.
+void
+vectorio(void)
+{
+  struct iovec iov[3];
+  char a[10], b[10], c[10];
+  int fd, i;
+
+  printf(1, "vectorio test\n");
+  unlink("vectorio");
+  fd = open("vectorio", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "vectorio: create failed\n");
+    exit();
+  }
+  iov[0].iov_base = "abc";
+  iov[0].iov_len = 3;
+  iov[1].iov_base = "";
+  iov[1].iov_len = 0;
+  iov[2].iov_base = "defgh";
+  iov[2].iov_len = 5;
+  if(writev(fd, iov, 3) != 8){
+    printf(1, "vectorio: writev failed\n");
+    exit();
+  }
+  if(pwrite(fd, "XY", 2, 1) != 2){
+    printf(1, "vectorio: pwrite failed\n");
+    exit();
+  }
+  if(write(fd, "ij", 2) != 2){
+    printf(1, "vectorio: pwrite moved the offset\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("vectorio", O_RDONLY);
+  iov[0].iov_base = a;
+  iov[0].iov_len = 4;
+  iov[1].iov_base = b;
+  iov[1].iov_len = 4;
+  iov[2].iov_base = c;
+  iov[2].iov_len = 10;
+  if(readv(fd, iov, 3) != 10 || !samebytes(a, "aXYd", 4) ||
+     !samebytes(b, "efgh", 4) || !samebytes(c, "ij", 2)){
+    printf(1, "vectorio: readv wrong data\n");
+    exit();
+  }
+  for(i = 0; i < 10; i++)
+    a[i] = 0;
+  if(pread(fd, a, 10, 6) != 4 || !samebytes(a, "ghij", 4)){
+    printf(1, "vectorio: pread wrong data\n");
+    exit();
+  }
+  if(pread(fd, a, 1, -1) != -1){
+    printf(1, "vectorio: pread negative offset succeeded\n");
+    exit();
+  }
+  iov[0].iov_base = (void*)0xffffff00;
+  if(readv(fd, iov, 1) != -1){
+    printf(1, "vectorio: readv bad address succeeded\n");
+    exit();
+  }
+  close(fd);
+  unlink("vectorio");
+  printf(1, "vectorio ok\n");
+}
+
+// copy_file_range copies between files inside the kernel,
+// from and to offsets that need not be block-aligned.
+void
+copyrange(void)
+{
+  int fd, fd1, i, n, p[2];
+  char *b;
+
+  printf(1, "copyrange test\n");
+  unlink("copysrc");
+  unlink("copydst");
+  fd = open("copysrc", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "copyrange: create failed\n");
+    exit();
+  }
+  for(i = 0; i < 6000; i++)
+    buf[i] = i % 251;
+  if(write(fd, buf, 6000) != 6000){
+    printf(1, "copyrange: write failed\n");
+    exit();
+  }
+  close(fd);
+
+  // Skip 100 bytes of the source, and write 7 to the
+  // destination first, so neither side is aligned.
+  fd = open("copysrc", O_RDONLY);
+  fd1 = open("copydst", O_CREATE|O_RDWR);
+  if(read(fd, buf, 100) != 100 || write(fd1, "prefix:", 7) != 7){
+    printf(1, "copyrange: setup failed\n");
+    exit();
+  }
+  if((n = copy_file_range(fd, fd1, 8000)) != 5900){
+    printf(1, "copyrange: copied %d, not 5900\n", n);
+    exit();
+  }
+  if(copy_file_range(fd, fd1, 10) != 0){
+    printf(1, "copyrange: copy at end of file failed\n");
+    exit();
+  }
+  if(pipe(p) < 0 || copy_file_range(fd, p[1], 10) != -1){
+    printf(1, "copyrange: copy into a pipe succeeded\n");
+    exit();
+  }
+  close(p[0]);
+  close(p[1]);
+  close(fd);
+  close(fd1);
+
+  fd = open("copydst", O_RDONLY);
+  if(read(fd, buf, sizeof(buf)) != 5907 || !samebytes(buf, "prefix:", 7)){
+    printf(1, "copyrange: destination has wrong size\n");
+    exit();
+  }
+  b = buf + 7;
+  for(i = 100; i < 6000; i++){
+    if((uchar)b[i-100] != i % 251){
+      printf(1, "copyrange: wrong byte at %d\n", i);
+      exit();
+    }
+  }
+  close(fd);
+  unlink("copysrc");
+  unlink("copydst");
+  printf(1, "copyrange ok\n");
+}
+
+void
+manyinodes(void)
+{
+  int i, j, pid, fd;
+  char name[4];
+
+  printf(1, "many inodes test\n");
+
+  for(i = 0; i < 5; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      name[0] = 'i';
+      name[1] = 'a' + i;
+      name[3] = 0;
+      for(j = 0; j < 12; j++){
+        name[2] = 'a' + j;
+        if((fd = open(name, O_CREATE | O_RDWR)) < 0){
+          printf(1, "create %s failed\n", name);
+          exit();
+        }
+      }
+      sleep(20);   // hold them open while the others open theirs
+      for(j = 0; j < 12; j++){
+        name[2] = 'a' + j;
+        unlink(name);
+      }
+      exit();
+    }
+  }
+  for(i = 0; i < 5; i++)
+    wait();
+
+  printf(1, "many inodes ok\n");
+}
+
 // test that fork fails gracefully
 // the forktest binary also does this, but it runs out of proc entries first.
 // inside the bigger usertests binary, we run out of memory first.
@@ -1418,7 +1930,7 @@ sbrktest(void)
   char *a, *b, *c, *lastaddr, *oldbrk, *p, scratch;
   uint amt;
 
-  printf(stdout, "sbrk test\n");
+  printf(1, "sbrk test\n");
   oldbrk = sbrk(0);
 
   // can one sbrk() less than a page?
@@ -1427,7 +1939,7 @@ sbrktest(void)
   for(i = 0; i < 5000; i++){
     b = sbrk(1);
     if(b != a){
-      printf(stdout, "sbrk test failed %d %x %x\n", i, a, b);
+      printf(1, "sbrk test failed %d %x %x\n", i, a, b);
       exit();
     }
     *b = 1;
@@ -1435,13 +1947,13 @@ sbrktest(void)
   }
   pid = fork();
   if(pid < 0){
-    printf(stdout, "sbrk test fork failed\n");
+    printf(1, "sbrk test fork failed\n");
     exit();
   }
   c = sbrk(1);
   c = sbrk(1);
   if(c != a + 1){
-    printf(stdout, "sbrk test failed post-fork\n");
+    printf(1, "sbrk test failed post-fork\n");
     exit();
   }
   if(pid == 0)
@@ -1454,7 +1966,7 @@ sbrktest(void)
   amt = (BIG) - (uint)a;
   p = sbrk(amt);
   if (p != a) {
-    printf(stdout, "sbrk test failed to grow big address space; enough phys mem?\n");
+    printf(1, "sbrk test failed to grow big address space; enough phys mem?\n");
     exit();
   }
   lastaddr = (char*) (BIG-1);
@@ -1464,12 +1976,12 @@ sbrktest(void)
   a = sbrk(0);
   c = sbrk(-4096);
   if(c == (char*)0xffffffff){
-    printf(stdout, "sbrk could not deallocate\n");
+    printf(1, "sbrk could not deallocate\n");
     exit();
   }
   c = sbrk(0);
   if(c != a - 4096){
-    printf(stdout, "sbrk deallocation produced wrong address, a %x c %x\n", a, c);
+    printf(1, "sbrk deallocation produced wrong address, a %x c %x\n", a, c);
     exit();
   }
 
@@ -1477,19 +1989,19 @@ sbrktest(void)
   a = sbrk(0);
   c = sbrk(4096);
   if(c != a || sbrk(0) != a + 4096){
-    printf(stdout, "sbrk re-allocation failed, a %x c %x\n", a, c);
+    printf(1, "sbrk re-allocation failed, a %x c %x\n", a, c);
     exit();
   }
   if(*lastaddr == 99){
     // should be zero
-    printf(stdout, "sbrk de-allocation didn't really deallocate\n");
+    printf(1, "sbrk de-allocation didn't really deallocate\n");
     exit();
   }
 
   a = sbrk(0);
   c = sbrk(-(sbrk(0) - oldbrk));
   if(c != a){
-    printf(stdout, "sbrk downsize failed, a %x c %x\n", a, c);
+    printf(1, "sbrk downsize failed, a %x c %x\n", a, c);
     exit();
   }
 
@@ -1498,11 +2010,11 @@ sbrktest(void)
     ppid = getpid();
     pid = fork();
     if(pid < 0){
-      printf(stdout, "fork failed\n");
+      printf(1, "fork failed\n");
       exit();
     }
     if(pid == 0){
-      printf(stdout, "oops could read %x = %x\n", a, *a);
+      printf(1, "oops could read %x = %x\n", a, *a);
       kill(ppid);
       exit();
     }
@@ -1536,14 +2048,14 @@ sbrktest(void)
     wait();
   }
   if(c == (char*)0xffffffff){
-    printf(stdout, "failed sbrk leaked memory\n");
+    printf(1, "failed sbrk leaked memory\n");
     exit();
   }
 
   if(sbrk(0) > oldbrk)
     sbrk(-(sbrk(0) - oldbrk));
 
-  printf(stdout, "sbrk test OK\n");
+  printf(1, "sbrk test OK\n");
 }
 
 void
@@ -1565,7 +2077,7 @@ validatetest(void)
   int hi, pid;
   uint p;
 
-  printf(stdout, "validate test\n");
+  printf(1, "validate test\n");
   hi = 1100*1024;
 
   for(p = 0; p <= (uint)hi; p += 4096){
@@ -1581,12 +2093,12 @@ validatetest(void)
 
     // try to crash the kernel by passing in a bad string pointer
     if(link("nosuchfile", (char*)p) != -1){
-      printf(stdout, "link should not succeed\n");
+      printf(1, "link should not succeed\n");
       exit();
     }
   }
 
-  printf(stdout, "validate ok\n");
+  printf(1, "validate ok\n");
 }
 
 // does unintialized data start out zero?
@@ -1596,14 +2108,14 @@ bsstest(void)
 {
   int i;
 
-  printf(stdout, "bss test\n");
+  printf(1, "bss test\n");
   for(i = 0; i < sizeof(uninit); i++){
     if(uninit[i] != '\0'){
-      printf(stdout, "bss test failed\n");
+      printf(1, "bss test failed\n");
       exit();
     }
   }
-  printf(stdout, "bss test ok\n");
+  printf(1, "bss test ok\n");
 }
 
 // does exec return an error if the arguments
@@ -1612,30 +2124,38 @@ bsstest(void)
 void
 bigargtest(void)
 {
-  int pid, fd;
+  int pid, fd, i;
+  static char *sargs[MAXARG];
+
+  for(i = 0; i < MAXARG-1; i++)
+    sargs[i] = "bigargs test: failed\n                                                                                                                                                                                                       ";
+  sargs[MAXARG-1] = 0;
+  if(spawn("echo", sargs, 0, 0) >= 0){
+    printf(1, "bigarg test: spawn succeeded\n");
+    exit();
+  }
 
   unlink("bigarg-ok");
   pid = fork();
   if(pid == 0){
     static char *args[MAXARG];
-    int i;
     for(i = 0; i < MAXARG-1; i++)
       args[i] = "bigargs test: failed\n                                                                                                                                                                                                       ";
     args[MAXARG-1] = 0;
-    printf(stdout, "bigarg test\n");
+    printf(1, "bigarg test\n");
     exec("echo", args);
-    printf(stdout, "bigarg test ok\n");
+    printf(1, "bigarg test ok\n");
     fd = open("bigarg-ok", O_CREATE);
     close(fd);
     exit();
   } else if(pid < 0){
-    printf(stdout, "bigargtest: fork failed\n");
+    printf(1, "bigargtest: fork failed\n");
     exit();
   }
   wait();
   fd = open("bigarg-ok", 0);
   if(fd < 0){
-    printf(stdout, "bigarg test failed!\n");
+    printf(1, "bigarg test failed!\n");
     exit();
   }
   close(fd);
@@ -1737,6 +2257,40 @@ void argptest()
   printf(1, "arg test passed\n");
 }
 
+// System call arguments on unmapped pages, or strings that
+// run into one, must fail rather than fault in the kernel.
+void
+badptrtest(void)
+{
+  char *top, *far, *argv[2];
+
+  printf(1, "bad pointer test\n");
+  top = sbrk(0);
+  if((uint)top % 4096)
+    sbrk(4096 - (uint)top % 4096);
+  // A page of our own, so as not to clobber malloc's.
+  top = sbrk(4096) + 4096;
+  far = top + 64*4096;
+  memset(top - 4, 'x', 4);
+  if(open(top - 4, 0) >= 0 || open(top, 0) >= 0 || open(far, 0) >= 0 ||
+     open((char*)0xfffffff0, 0) >= 0){
+    printf(1, "bad pointer test: open succeeded\n");
+    exit();
+  }
+  if(exec("echo", (char**)far) >= 0 || exec("echo", (char**)(top - 2)) >= 0){
+    printf(1, "bad pointer test: exec argv succeeded\n");
+    exit();
+  }
+  argv[0] = top - 4;
+  argv[1] = 0;
+  if(exec("echo", argv) >= 0){
+    printf(1, "bad pointer test: exec string succeeded\n");
+    exit();
+  }
+  sbrk(-4096);
+  printf(1, "bad pointer test ok\n");
+}
+
 unsigned long randstate = 1;
 unsigned int
 rand()
@@ -1757,6 +2311,7 @@ main(int argc, char *argv[])
   close(open("usertests.ran", O_CREATE));
 
   argptest();
+  badptrtest();
   createdelete();
   linkunlink();
   concreate();
@@ -1780,6 +2335,7 @@ main(int argc, char *argv[])
   iputtest();
 
   mem();
+  mallocbench();
   pipe1();
   preempt();
   exitwait();
@@ -1792,11 +2348,19 @@ main(int argc, char *argv[])
   unlinkread();
   dirfile();
   iref();
+  manyinodes();
+  vectorio();
+  copyrange();
   forktest();
   bigdir(); // slow
 
   uio();
 
+  spawntest();
+  textcache();
+  textprot();
+  threadtest();
+  futextest();
   exectest();
 
   exit();
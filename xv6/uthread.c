@@ -0,0 +1,140 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+// User threads on clone() and join(). Each thread gets a
+// page of stack from malloc(); thread_join() frees it.
+//
+// Spin locks busy-wait; mutexes and condition variables
+// sleep in futex_wait(). Both work in memory shared between
+// processes with open_sharedmem() as well as between threads.
+
+#define PGSIZE 4096
+
+void
+lock_init(lock_t *lk)
+{
+  lk->locked = 0;
+}
+
+void
+lock_acquire(lock_t *lk)
+{
+  while(xchg(&lk->locked, 1) != 0)
+    ;
+}
+
+void
+lock_release(lock_t *lk)
+{
+  xchg(&lk->locked, 0);
+}
+
+// A mutex is taken with one cmpxchg when free. A locker that
+// has to wait sets the state to 2 so that the unlocker knows
+// to call futex_wake().
+void
+mutex_init(mutex_t *m)
+{
+  m->state = 0;
+}
+
+// Take m, marking it contended, as a locker that may have
+// had company while it slept must.
+static void
+mutex_lock2(mutex_t *m)
+{
+  while(xchg(&m->state, 2) != 0)
+    futex_wait(&m->state, 2);
+}
+
+void
+mutex_lock(mutex_t *m)
+{
+  if(cmpxchg(&m->state, 0, 1) != 0)
+    mutex_lock2(m);
+}
+
+void
+mutex_unlock(mutex_t *m)
+{
+  if(xchg(&m->state, 0) == 2)
+    futex_wake(&m->state, 1);
+}
+
+void
+cond_init(cond_t *c)
+{
+  c->seq = 0;
+}
+
+// Release m and sleep until signalled, then take m again.
+// As with any condition variable, the caller must recheck
+// its condition: wakeups may be spurious.
+void
+cond_wait(cond_t *c, mutex_t *m)
+{
+  uint seq;
+
+  seq = c->seq;
+  mutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  mutex_lock2(m);
+}
+
+static void
+bump(cond_t *c)
+{
+  uint seq;
+
+  do
+    seq = c->seq;
+  while(cmpxchg(&c->seq, seq, seq+1) != seq);
+}
+
+void
+cond_signal(cond_t *c)
+{
+  bump(c);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(cond_t *c)
+{
+  bump(c);
+  futex_wake(&c->seq, 0x7fffffff);
+}
+
+// Run fn(arg1, arg2) in a new thread, which must end with
+// exit(). Returns its pid, or -1.
+int
+thread_create(void (*fn)(void*, void*), void *arg1, void *arg2)
+{
+  char *mem, *stack;
+  int pid;
+
+  // clone() wants a whole page; keep malloc's pointer in the
+  // word below it for thread_join().
+  if((mem = malloc(2*PGSIZE)) == 0)
+    return -1;
+  stack = (char*)(((uint)mem + sizeof(char*) + PGSIZE-1) & ~(PGSIZE-1));
+  ((char**)stack)[-1] = mem;
+  if((pid = clone(fn, arg1, arg2, stack)) < 0)
+    free(mem);
+  return pid;
+}
+
+// Wait for a thread to exit and free its stack.
+// Returns its pid, or -1 if there are none.
+int
+thread_join(void)
+{
+  void *stack;
+  int pid;
+
+  if((pid = join(&stack)) >= 0)
+    free(((char**)stack)[-1]);
+  return pid;
+}
@@ -0,0 +1,286 @@
+// Virtio block device driver, for the legacy PCI interface
+// that QEMU's virtio-blk-pci device provides.
+// A drop-in replacement for ide.c: build with "make DISK=virtio".
+//
+// Unlike ide.c, which has one command in flight, requests are
+// posted to a queue of descriptor chains that the device works
+// through on its own. Each request is a header descriptor, one
+// data descriptor per buf, and a status descriptor, so a run of
+// consecutive blocks is a single request.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "traps.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "pci.h"
+#include "virtio.h"
+
+#define SECTOR_SIZE   512
+#define NDESC         64    // descriptors the driver uses
+#define VIRTIO_MAXRUN 16    // max bufs in one request
+#define VIRTIO_MAXQ   1024  // largest device queue size supported
+
+// Memory for the rings. Legacy devices are given a single
+// physical page number, so the rings must be physically
+// contiguous: use kernel data rather than kalloc()ed pages.
+static char vqmem[8*PGSIZE] __attribute__((aligned(PGSIZE)));
+
+static struct {
+  struct spinlock lock;
+  ushort iobase;
+  uint qsize;      // entries in the device's rings
+  uint ndesc;      // descriptors in use by us, <= qsize
+
+  struct virtq_desc *desc;
+  struct virtq_avail *avail;
+  volatile struct virtq_used *used;
+
+  char free[NDESC];  // is a descriptor free?
+  int nfree;
+  ushort usedidx;    // how far we have looked in used->ring
+
+  // Per-request state, indexed by the first descriptor of the chain.
+  struct {
+    struct virtio_blk_outhdr hdr;
+    uchar status;
+    struct buf *b;   // first buf; the rest are linked by qnext
+  } info[NDESC];
+} vdisk;
+
+void
+ideinit(void)
+{
+  struct pcidev d;
+  uint availsz, usedoff, usedsz, i;
+
+  initlock(&vdisk.lock, "virtio");
+
+  if(pcifind(VIRTIO_VENDOR, VIRTIO_DEV_BLK, PCI_ANY, &d) < 0)
+    panic("virtio: no block device");
+  if((d.bar[0] & 1) == 0)
+    panic("virtio: no legacy i/o bar");
+  pcienable(&d);
+  vdisk.iobase = d.bar[0] & ~3;
+
+  // Reset, then say we know how to drive the device.
+  outb(vdisk.iobase + VIRTIO_STATUS, 0);
+  outb(vdisk.iobase + VIRTIO_STATUS, VIRTIO_STATUS_ACK);
+  outb(vdisk.iobase + VIRTIO_STATUS, VIRTIO_STATUS_ACK|VIRTIO_STATUS_DRIVER);
+
+  // No optional features: plain split rings, no event index.
+  inl(vdisk.iobase + VIRTIO_HOST_FEATURES);
+  outl(vdisk.iobase + VIRTIO_GUEST_FEATURES, 0);
+
+  // Lay out queue 0 as the legacy interface requires:
+  // descriptors, avail ring, then the used ring on the next page.
+  outw(vdisk.iobase + VIRTIO_QUEUE_SEL, 0);
+  vdisk.qsize = inw(vdisk.iobase + VIRTIO_QUEUE_SIZE);
+  if(vdisk.qsize == 0 || vdisk.qsize > VIRTIO_MAXQ)
+    panic("virtio: bad queue size");
+  availsz = sizeof(struct virtq_avail) + 2*vdisk.qsize + 2;
+  usedoff = PGROUNDUP(16*vdisk.qsize + availsz);
+  usedsz = sizeof(struct virtq_used) + 8*vdisk.qsize + 2;
+  if(usedoff + usedsz > sizeof(vqmem))
+    panic("virtio: queue too big");
+  memset(vqmem, 0, sizeof(vqmem));
+  vdisk.desc = (struct virtq_desc*)vqmem;
+  vdisk.avail = (struct virtq_avail*)(vqmem + 16*vdisk.qsize);
+  vdisk.used = (struct virtq_used*)(vqmem + usedoff);
+  outl(vdisk.iobase + VIRTIO_QUEUE_PFN, V2P(vqmem) / VIRTIO_ALIGN);
+
+  vdisk.ndesc = vdisk.qsize < NDESC ? vdisk.qsize : NDESC;
+  for(i = 0; i < vdisk.ndesc; i++)
+    vdisk.free[i] = 1;
+  vdisk.nfree = vdisk.ndesc;
+
+  outb(vdisk.iobase + VIRTIO_STATUS,
+       VIRTIO_STATUS_ACK|VIRTIO_STATUS_DRIVER|VIRTIO_STATUS_DRIVER_OK);
+
+  // trap.c sends disk interrupts to ideintr(), so deliver the
+  // device's PCI interrupt on the IDE vector.
+  ioapicroute(d.irq, IRQ_IDE, ncpu - 1);
+  cprintf("virtio: block device, queue size %d, irq %d\n", vdisk.qsize, d.irq);
+}
+
+// Find n free descriptors and chain them through next,
+// writing their indices to idx[]. Returns -1 if there
+// aren't enough. Caller must hold vdisk.lock.
+static int
+alloc_desc(int *idx, int n)
+{
+  int i, j;
+
+  if(vdisk.nfree < n)
+    return -1;
+  for(i = 0, j = 0; i < n; j++){
+    if(vdisk.free[j]){
+      vdisk.free[j] = 0;
+      idx[i++] = j;
+    }
+  }
+  vdisk.nfree -= n;
+  return 0;
+}
+
+// Free the chain of descriptors that starts at i.
+static void
+free_chain(int i)
+{
+  int flags;
+
+  for(;;){
+    if(vdisk.free[i])
+      panic("virtio: free_chain");
+    flags = vdisk.desc[i].flags;
+    vdisk.free[i] = 1;
+    vdisk.nfree++;
+    if((flags & VRING_DESC_F_NEXT) == 0)
+      break;
+    i = vdisk.desc[i].next;
+  }
+  wakeup(&vdisk.free);
+}
+
+static void
+setdesc(int i, void *va, uint len, int flags, int next)
+{
+  vdisk.desc[i].addr = V2P(va);
+  vdisk.desc[i].addrhi = 0;
+  vdisk.desc[i].len = len;
+  vdisk.desc[i].flags = flags;
+  vdisk.desc[i].next = next;
+}
+
+// Post one request for the n bufs starting at bs[0], which
+// are consecutive on disk and all reads or all writes.
+// Caller must hold vdisk.lock.
+static void
+virtio_post(struct buf **bs, int n)
+{
+  int idx[VIRTIO_MAXRUN+2], i, write;
+
+  while(alloc_desc(idx, n+2) < 0){
+    // Let the device work on what is queued while we wait.
+    outw(vdisk.iobase + VIRTIO_QUEUE_NOTIFY, 0);
+    sleep(&vdisk.free, &vdisk.lock);
+  }
+
+  write = (bs[0]->flags & B_DIRTY) != 0;
+  vdisk.info[idx[0]].hdr.type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  vdisk.info[idx[0]].hdr.reserved = 0;
+  vdisk.info[idx[0]].hdr.sector = bs[0]->blockno * (BSIZE/SECTOR_SIZE);
+  vdisk.info[idx[0]].hdr.sectorhi = 0;
+  vdisk.info[idx[0]].status = 0xff;  // device writes 0 on success
+  vdisk.info[idx[0]].b = bs[0];
+
+  setdesc(idx[0], &vdisk.info[idx[0]].hdr, sizeof(struct virtio_blk_outhdr),
+          VRING_DESC_F_NEXT, idx[1]);
+  for(i = 0; i < n; i++){
+    setdesc(idx[i+1], bs[i]->data, BSIZE,
+            VRING_DESC_F_NEXT | (write ? 0 : VRING_DESC_F_WRITE), idx[i+2]);
+    bs[i]->qnext = i+1 < n ? bs[i+1] : 0;
+  }
+  setdesc(idx[n+1], &vdisk.info[idx[0]].status, 1, VRING_DESC_F_WRITE, 0);
+
+  // Publish the chain head, then the new avail index.
+  vdisk.avail->ring[vdisk.avail->idx % vdisk.qsize] = idx[0];
+  __sync_synchronize();
+  vdisk.avail->idx++;
+  __sync_synchronize();
+}
+
+// Can b2 go in the same request as b, right after it?
+static int
+virtio_adjacent(struct buf *b, struct buf *b2)
+{
+  return b2->dev == b->dev && b2->blockno == b->blockno + 1 &&
+         (b2->flags & B_DIRTY) == (b->flags & B_DIRTY);
+}
+
+// Interrupt handler.
+void
+ideintr(void)
+{
+  struct buf *b;
+  int id;
+
+  acquire(&vdisk.lock);
+
+  // Reading the ISR acknowledges the interrupt, so any
+  // completion after this point raises a new one.
+  inb(vdisk.iobase + VIRTIO_ISR);
+  __sync_synchronize();
+
+  while(vdisk.usedidx != vdisk.used->idx){
+    __sync_synchronize();
+    id = vdisk.used->ring[vdisk.usedidx % vdisk.qsize].id;
+    if(vdisk.info[id].status != 0)
+      panic("virtio: request failed");
+
+    // Wake processes waiting for the request's bufs.
+    for(b = vdisk.info[id].b; b; b = b->qnext){
+      b->flags |= B_VALID;
+      b->flags &= ~B_DIRTY;
+      wakeup(b);
+    }
+    vdisk.info[id].b = 0;
+    free_chain(id);
+    vdisk.usedidx++;
+  }
+
+  release(&vdisk.lock);
+}
+
+//PAGEBREAK!
+// Sync n bufs with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+// All requests are queued before the device is notified, and runs
+// of consecutive blocks are sent as single requests.
+void
+iderwv(struct buf **bs, int n)
+{
+  int i, m;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("iderw: buf not locked");
+    if((bs[i]->flags & (B_VALID|B_DIRTY)) == B_VALID)
+      panic("iderw: nothing to do");
+    if(bs[i]->dev != ROOTDEV)
+      panic("iderw: request not for disk 1");
+    if(bs[i]->blockno >= FSSIZE)
+      panic("incorrect blockno");
+  }
+
+  acquire(&vdisk.lock);
+
+  for(i = 0; i < n; i += m){
+    for(m = 1; i+m < n && m < VIRTIO_MAXRUN; m++)
+      if(!virtio_adjacent(bs[i+m-1], bs[i+m]))
+        break;
+    virtio_post(bs+i, m);
+  }
+  outw(vdisk.iobase + VIRTIO_QUEUE_NOTIFY, 0);
+
+  // Wait for requests to finish.
+  for(i = 0; i < n; i++)
+    while((bs[i]->flags & (B_VALID|B_DIRTY)) != B_VALID)
+      sleep(bs[i], &vdisk.lock);
+
+  release(&vdisk.lock);
+}
+
+void
+iderw(struct buf *b)
+{
+  iderwv(&b, 1);
+}
@@ -0,0 +1,67 @@
+// Virtio legacy PCI interface, as used by virtio.c.
+// See the virtio 0.9.5 / 1.0 "legacy interface" specification.
+
+// Registers in the device's I/O space (BAR0).
+#define VIRTIO_HOST_FEATURES  0x00  // 32 bits, read-only
+#define VIRTIO_GUEST_FEATURES 0x04  // 32 bits
+#define VIRTIO_QUEUE_PFN      0x08  // 32 bits, physical page of the ring
+#define VIRTIO_QUEUE_SIZE     0x0C  // 16 bits, read-only
+#define VIRTIO_QUEUE_SEL      0x0E  // 16 bits
+#define VIRTIO_QUEUE_NOTIFY   0x10  // 16 bits
+#define VIRTIO_STATUS         0x12  // 8 bits
+#define VIRTIO_ISR            0x13  // 8 bits, read clears
+#define VIRTIO_CONFIG         0x14  // device-specific configuration
+
+// Device status bits.
+#define VIRTIO_STATUS_ACK       1
+#define VIRTIO_STATUS_DRIVER    2
+#define VIRTIO_STATUS_DRIVER_OK 4
+#define VIRTIO_STATUS_FAILED    128
+
+#define VIRTIO_VENDOR   0x1AF4
+#define VIRTIO_DEV_BLK  0x1001  // transitional block device
+
+// Legacy rings are aligned to this, and the queue address
+// is given to the device as a page number.
+#define VIRTIO_ALIGN    4096
+
+// Descriptor table entry.
+struct virtq_desc {
+  uint addr;       // physical address, low 32 bits
+  uint addrhi;     // high 32 bits, always 0 here
+  uint len;
+  ushort flags;
+  ushort next;
+};
+#define VRING_DESC_F_NEXT  1  // chained with another descriptor
+#define VRING_DESC_F_WRITE 2  // device writes (vs read)
+
+// The (entire) avail ring, from driver to device.
+struct virtq_avail {
+  ushort flags;
+  ushort idx;      // where the driver will put the next entry
+  ushort ring[];   // descriptor numbers of chain heads
+};
+
+// One entry in the "used" ring, with which the
+// device tells the driver about completed requests.
+struct virtq_used_elem {
+  uint id;         // index of start of completed descriptor chain
+  uint len;
+};
+
+struct virtq_used {
+  ushort flags;
+  ushort idx;
+  struct virtq_used_elem ring[];
+};
+
+// Block request header, the first descriptor of every request.
+struct virtio_blk_outhdr {
+  uint type;
+  uint reserved;
+  uint sector;     // low 32 bits
+  uint sectorhi;
+};
+#define VIRTIO_BLK_T_IN  0  // read the disk
+#define VIRTIO_BLK_T_OUT 1  // write the disk
@@ -11,6 +11,7 @@
 
 extern char data[]; // defined by kernel.ld
 pde_t *kpgdir;      // for use in scheduler()
+struct spinlock cowlock; // threads may fault on one page at once
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -148,6 +149,7 @@ void kvmalloc(void)
 {
   kpgdir = setupkvm();
   switchkvm();
+  initlock(&cowlock, "cow");
 }
 
 // Switch h/w page table register to the kernel-only page table,
@@ -195,26 +197,55 @@ void inituvm(pde_t *pgdir, char *init, uint sz)
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
+// Map program segment ph of ip into pgdir, whose pages from
+// the one holding ph->vaddr on must not be mapped yet. Pages
+// come from the program cache when they can (see exec.c) and
+// are shared: read-only for a read-only segment, copy-on-write
+// for a writable one. Pages read from the file are added to
+// the cache. Bytes of a page outside the segment's file data
+// are zero.
+int loaduvm(pde_t *pgdir, struct inode *ip, struct proghdr *ph)
 {
-  uint i, pa, n;
-  pte_t *pte;
+  uint va, lo, hi, end, flags;
+  char *mem;
 
-  if ((uint)addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for (i = 0; i < sz; i += PGSIZE)
+  flags = (ph->flags & ELF_PROG_FLAG_WRITE) ? PTE_U | PTE_COW : PTE_U;
+  end = ph->vaddr + ph->filesz;
+  for (va = PGROUNDDOWN(ph->vaddr); va < ph->vaddr + ph->memsz; va += PGSIZE)
   {
-    if ((pte = walkpgdir(pgdir, addr + i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if (sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if (readi(ip, P2V(pa), offset + i, n) != n)
+    lo = va < ph->vaddr ? ph->vaddr : va;
+    hi = va + PGSIZE < end ? va + PGSIZE : end;
+    if (lo >= hi)
+    {
+      // Only bss: a private zero page.
+      if ((mem = kalloc()) == 0)
+        return -1;
+      memset(mem, 0, PGSIZE);
+      if (mappages(pgdir, (char *)va, PGSIZE, V2P(mem), PTE_W | PTE_U) < 0)
+      {
+        kfree(mem);
+        return -1;
+      }
+      continue;
+    }
+    if ((mem = textget(ip, va)) == 0)
+    {
+      if ((mem = kalloc()) == 0)
+        return -1;
+      memset(mem, 0, PGSIZE);
+      if (readi(ip, mem + (lo - va), ph->off + (lo - ph->vaddr), hi - lo) != hi - lo)
+      {
+        kfree(mem);
+        return -1;
+      }
+      kref(mem);
+      textput(ip, va, mem);
+    }
+    if (mappages(pgdir, (char *)va, PGSIZE, V2P(mem), flags) < 0)
+    {
+      kfree(mem);
       return -1;
+    }
   }
   return 0;
 }
@@ -337,6 +368,15 @@ copyuvm(pde_t *pgdir, uint sz)
       panic("copyuvm: page not present");
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
+    if ((flags & (PTE_W | PTE_U)) == PTE_U)
+    {
+      // Read-only or copy-on-write, such as shared program
+      // text and data: share it.
+      if (mappages(d, (void *)i, PGSIZE, pa, flags) < 0)
+        goto bad;
+      kref(P2V(pa));
+      continue;
+    }
     if ((mem = kalloc()) == 0)
       goto bad;
     memmove(mem, (char *)P2V(pa), PGSIZE);
@@ -361,7 +401,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if ((*pte & PTE_P) == 0)
+  if (pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if ((*pte & PTE_U) == 0)
     return 0;
@@ -394,6 +434,90 @@ int copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
+// Give pgdir its own writable copy of the copy-on-write page
+// at user address va. Returns -1 if the page is not
+// copy-on-write or memory is short. A page that is already
+// writable counts as done: another thread of the process got
+// there first, and this CPU had a stale translation.
+int uvmcow(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *mem;
+  uint pa;
+
+  if (va >= KERNBASE)
+    return -1;
+  acquire(&cowlock);
+  pte = walkpgdir(pgdir, (char *)va, 0);
+  if (pte && (*pte & (PTE_P | PTE_U | PTE_W)) == (PTE_P | PTE_U | PTE_W))
+    goto flush;
+  if (pte == 0 || (*pte & (PTE_P | PTE_U | PTE_COW)) != (PTE_P | PTE_U | PTE_COW) ||
+      (mem = kalloc()) == 0)
+  {
+    release(&cowlock);
+    return -1;
+  }
+  pa = PTE_ADDR(*pte);
+  memmove(mem, (char *)P2V(pa), PGSIZE);
+  *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  kfree((char *)P2V(pa));
+flush:
+  release(&cowlock);
+  if (myproc() && pgdir == myproc()->pgdir)
+    lcr3(V2P(pgdir)); // flush the old translation
+  return 0;
+}
+
+// Copy every copy-on-write page of pgdir below sz, so that
+// threads sharing pgdir never fault on one.
+int uvmcowall(pde_t *pgdir, uint sz)
+{
+  pte_t *pte;
+  uint a;
+
+  for (a = 0; a < sz; a += PGSIZE)
+  {
+    pte = walkpgdir(pgdir, (char *)a, 0);
+    if (pte && (*pte & PTE_COW) && uvmcow(pgdir, a) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Make sure the kernel may write n bytes at user address va
+// of pgdir, copying copy-on-write pages. The kernel runs with
+// CR0_WP set, so writing a read-only page, such as shared
+// program text, would fault.
+int uvmwritable(pde_t *pgdir, uint va, uint n)
+{
+  pte_t *pte;
+  uint a;
+
+  if (va >= KERNBASE || n > KERNBASE - va)
+    return 0;
+  for (a = PGROUNDDOWN(va); a < va + n; a += PGSIZE)
+  {
+    pte = walkpgdir(pgdir, (char *)a, 0);
+    if (pte == 0 || (*pte & (PTE_P | PTE_U)) != (PTE_P | PTE_U))
+      return 0;
+    if ((*pte & PTE_COW) && uvmcow(pgdir, a) < 0)
+      return 0;
+    if (!(*pte & PTE_W))
+      return 0;
+  }
+  return 1;
+}
+
+// Copy n bytes from user address va of the current process
+// to dst. The range need not be checked against the process
+// size: a fault on an unmapped page makes ucopy() return -1.
+int copyin(void *dst, uint va, uint n)
+{
+  if (va >= KERNBASE || n > KERNBASE - va)
+    return -1;
+  return ucopy(dst, (void *)va, n);
+}
+
 struct shmRegion
 {
   uint key, size;
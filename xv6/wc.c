@@ -5,14 +5,14 @@
 char buf[512];
 
 void
-wc(int fd, char *name)
+wc(FILE *f, char *name)
 {
   int i, n;
   int l, w, c, inword;
 
   l = w = c = 0;
   inword = 0;
-  while((n = read(fd, buf, sizeof(buf))) > 0){
+  while((n = fread(buf, 1, sizeof(buf), f)) > 0){
     for(i=0; i<n; i++){
       c++;
       if(buf[i] == '\n')
@@ -25,7 +25,7 @@ wc(int fd, char *name)
       }
     }
   }
-  if(n < 0){
+  if(ferror(f)){
     printf(1, "wc: read error\n");
     exit();
   }
@@ -35,20 +35,21 @@ wc(int fd, char *name)
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  FILE *f;
+  int i;
 
   if(argc <= 1){
-    wc(0, "");
+    wc(stdin, "");
     exit();
   }
 
   for(i = 1; i < argc; i++){
-    if((fd = open(argv[i], 0)) < 0){
+    if((f = fopen(argv[i], "r")) == 0){
       printf(1, "wc: cannot open %s\n", argv[i]);
       exit();
     }
-    wc(fd, argv[i]);
-    close(fd);
+    wc(f, argv[i]);
+    fclose(f);
   }
   exit();
 }